@@ -0,0 +1,262 @@
+#include "automaton.h"
+#include "compiled_dfa.h"
+#include "max_matching_prefix.h"
+#include "nfa_simulator.h"
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Times automaton operations on families of workloads of growing size and prints the results as JSON:
+//   automata_bench [--filter <substring of operation/workload>] [--max-size <n>] [--min-time <seconds>]
+// Every result holds the mean wall time of one run, the number of states the operation produced (for operations
+// that build no automaton, the size of what they return, such as the length of a regex) and the peak resident
+// set size reached while it ran.
+namespace {
+  struct Options {
+    std::string filter;
+    std::size_t max_size = std::numeric_limits<std::size_t>::max();
+    double min_time = 0.05;
+  };
+
+  struct Result {
+    std::string operation;
+    std::string workload;
+    std::size_t size;
+    std::size_t run_number;
+    double wall_time_ns;
+    std::size_t state_number;
+    std::size_t peak_rss_kb;
+  };
+
+  // The kernel keeps the peak resident set size of the process in VmHWM; writing 5 to clear_refs resets it
+  // to the current size, so that every benchmark gets its own peak. Memory freed by earlier benchmarks is
+  // returned to the system first. Both files are Linux-only, elsewhere the peak is 0.
+  void ResetPeakRss() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    std::ofstream("/proc/self/clear_refs") << "5";
+  }
+
+  std::size_t GetPeakRssKb() {
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+      if (line.starts_with("VmHWM:")) {
+        return std::stoul(line.substr(std::strlen("VmHWM:")));
+      }
+    }
+    return 0;
+  }
+
+  class Benchmark {
+  public:
+    explicit Benchmark(Options options) : options_(std::move(options)) {}
+
+    // Runs the operation until min_time has passed; it returns the number of states it produced.
+    void Run(const std::string &operation, const std::string &workload, std::size_t size,
+             const std::function<std::size_t()> &function) {
+      auto name = operation + "/" + workload;
+      if (size > options_.max_size || name.find(options_.filter) == std::string::npos) {
+        return;
+      }
+      ResetPeakRss();
+      std::size_t run_number = 0;
+      std::size_t state_number = 0;
+      auto start = std::chrono::steady_clock::now();
+      std::chrono::duration<double> elapsed{};
+      do {
+        state_number = function();
+        ++run_number;
+        elapsed = std::chrono::steady_clock::now() - start;
+      } while (elapsed.count() < options_.min_time);
+      results_.push_back({operation, workload, size, run_number, elapsed.count() * 1e9 / run_number, state_number,
+                          GetPeakRssKb()});
+      std::cerr << name << " " << size << ": " << results_.back().wall_time_ns / 1e6 << " ms" << std::endl;
+    }
+
+    void Print(std::ostream &os) const {
+      os << "{\n  \"benchmarks\": [";
+      for (std::size_t i = 0; i < results_.size(); ++i) {
+        const auto &result = results_[i];
+        os << (i ? "," : "") << "\n    {\"operation\": \"" << result.operation << "\", \"workload\": \""
+           << result.workload << "\", \"size\": " << result.size << ", \"runs\": " << result.run_number
+           << ", \"wall_time_ns\": " << static_cast<std::uint64_t>(result.wall_time_ns) << ", \"states\": "
+           << result.state_number << ", \"peak_rss_kb\": " << result.peak_rss_kb << "}";
+      }
+      os << "\n  ]\n}" << std::endl;
+    }
+
+  private:
+    Options options_;
+    std::vector<Result> results_;
+  };
+
+  // (a+b)*a(a+b)^n: the minimal DFA has 2^(n+1) states.
+  regex::Regex NthSymbolFromEnd(std::size_t n) {
+    std::string expression = "(a+b)*a";
+    for (std::size_t i = 0; i < n; ++i) {
+      expression += "(a+b)";
+    }
+    return regex::Regex::Parse(expression);
+  }
+
+  // (abc...)* of n letters, a long chain with a single cycle.
+  regex::Regex LiteralChain(std::size_t n) {
+    std::string expression = "(";
+    for (std::size_t i = 0; i < n; ++i) {
+      expression += static_cast<char>('a' + i % 3);
+    }
+    return regex::Regex::Parse(expression + ")*");
+  }
+
+  // n states, two transitions per state and symbol and n / 4 empty transitions.
+  automata::NondeterministicAutomaton RandomNfa(std::size_t n) {
+    std::mt19937 generator(n);
+    std::uniform_int_distribution<std::size_t> state_distribution(0, n - 1);
+    automata::NondeterministicAutomaton automaton(n, 0);
+    for (std::size_t state = 0; state < n; ++state) {
+      automaton.SetAccepting(state, generator() % 4 == 0);
+      for (const auto *symbol: {"a", "a", "b", "b"}) {
+        automaton.AddTransition(state, state_distribution(generator), symbol);
+      }
+    }
+    for (std::size_t i = 0; i < n / 4; ++i) {
+      automaton.AddTransition(state_distribution(generator), state_distribution(generator), "");
+    }
+    return automaton;
+  }
+
+  std::string RandomString(std::size_t length, std::size_t seed) {
+    std::mt19937 generator(seed);
+    std::string string(length, 'a');
+    for (auto &symbol: string) {
+      symbol = "ab"[generator() % 2];
+    }
+    return string;
+  }
+
+  void RunRegexWorkload(Benchmark &benchmark, const std::string &workload, const regex::Regex &regex,
+                        std::size_t size) {
+    using automata::NondeterministicAutomaton;
+    benchmark.Run("FromRegex", workload, size, [&] {
+      return NondeterministicAutomaton::FromRegex(regex).GetStateNumber();
+    });
+    auto nfa = NondeterministicAutomaton::FromRegex(regex);
+    benchmark.Run("RemoveEmptyTransitions", workload, size, [&] {
+      return nfa.RemoveEmptyTransitions().GetStateNumber();
+    });
+    auto without_empty = nfa.RemoveEmptyTransitions();
+    benchmark.Run("Determinize", workload, size, [&] {
+      return without_empty.Determinize().GetStateNumber();
+    });
+    // Minimization needs a complete automaton.
+    auto dfa = without_empty.Determinize().MakeComplete({'a', 'b', 'c'});
+    for (auto [name, algorithm]: {std::pair{"Minimize/Hopcroft", automata::MinimizationAlgorithm::kHopcroft},
+                                  std::pair{"Minimize/Moore", automata::MinimizationAlgorithm::kMoore}}) {
+      benchmark.Run(name, workload, size, [&] {
+        return dfa.Minimize(algorithm).GetStateNumber();
+      });
+    }
+    auto minimal = dfa.Minimize();
+    benchmark.Run("Intersection", workload, size, [&] {
+      return dfa.Intersection(minimal).GetStateNumber();
+    });
+    benchmark.Run("IsEquivalent", workload, size, [&] {
+      return dfa.IsEquivalent(minimal) ? dfa.GetStateNumber() : 0;
+    });
+    auto string = RandomString(1 << 16, size);
+    benchmark.Run("AcceptsString/DFA", workload, size, [&] {
+      return dfa.AcceptsString(string) ? 1 : 0;
+    });
+    automata::NfaSimulator simulator(without_empty);
+    benchmark.Run("AcceptsString/NFA", workload, size, [&] {
+      return simulator.AcceptsString(string) ? 1 : 0;
+    });
+    automata::CompiledDfa compiled(dfa);
+    std::vector<std::string> strings;
+    for (std::size_t i = 0; i < automata::CompiledDfa::kMaxInterleavedStrings; ++i) {
+      strings.push_back(RandomString(1 << 12, size + i));
+    }
+    std::vector<std::string_view> views(strings.begin(), strings.end());
+    for (auto [name, kernel]: {std::pair{"AcceptsInterleaved/scalar", automata::CompiledDfa::Kernel::kScalar},
+                               std::pair{"AcceptsInterleaved/AVX2", automata::CompiledDfa::Kernel::kAvx2}}) {
+      benchmark.Run(name, workload, size, [&] {
+        return std::popcount(compiled.AcceptsInterleaved(views.data(), views.size(), kernel));
+      });
+    }
+    benchmark.Run("MaxMatchingPrefixFinder", workload, size, [&] {
+      return MaxMatchingPrefixFinder::GetMaxMatchingPrefix(regex, string.substr(0, 1 << 12));
+    });
+  }
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--filter") == 0) {
+      options.filter = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--max-size") == 0) {
+      options.max_size = std::stoul(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--min-time") == 0) {
+      options.min_time = std::stod(argv[i + 1]);
+    } else {
+      std::cerr << "Unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  Benchmark benchmark(options);
+
+  for (std::size_t n: {4, 8, 12, 16}) {
+    if (n <= options.max_size) {
+      RunRegexWorkload(benchmark, "nth_symbol_from_end", NthSymbolFromEnd(n), n);
+    }
+  }
+  for (std::size_t n: {16, 256, 4096}) {
+    if (n <= options.max_size) {
+      RunRegexWorkload(benchmark, "literal_chain", LiteralChain(n), n);
+    }
+  }
+  // State elimination is exponential in the worst case, so regexes are built from small automata only.
+  for (std::size_t n: {2, 4, 6}) {
+    auto nfa = automata::NondeterministicAutomaton::FromRegex(NthSymbolFromEnd(n)).RemoveEmptyTransitions();
+    nfa.MakeSingleAcceptingState();
+    benchmark.Run("ToRegex", "nth_symbol_from_end", n, [&] {
+      return nfa.ToRegex().ToString().size();
+    });
+  }
+  for (std::size_t n: {8, 16, 32, 64}) {
+    auto nfa = RandomNfa(n);
+    benchmark.Run("RemoveEmptyTransitions", "random_nfa", n, [&] {
+      return nfa.RemoveEmptyTransitions().GetStateNumber();
+    });
+    auto without_empty = nfa.RemoveEmptyTransitions();
+    benchmark.Run("Determinize", "random_nfa", n, [&] {
+      return without_empty.Determinize().GetStateNumber();
+    });
+    auto dfa = without_empty.Determinize().MakeComplete({'a', 'b'});
+    benchmark.Run("Minimize/Hopcroft", "random_nfa", n, [&] {
+      return dfa.Minimize().GetStateNumber();
+    });
+    benchmark.Run("IsEquivalent/NFA", "random_nfa", n, [&] {
+      return without_empty.IsEquivalent(automata::NondeterministicAutomaton(dfa)) ? n : 0;
+    });
+  }
+  for (std::size_t n: {3, 5}) {
+    auto nfa = RandomNfa(n).RemoveEmptyTransitions();
+    nfa.MakeSingleAcceptingState();
+    benchmark.Run("ToRegex", "random_nfa", n, [&] {
+      return nfa.ToRegex().ToString().size();
+    });
+  }
+  benchmark.Print(std::cout);
+}
@@ -3,7 +3,10 @@
 
 #include "regex.h"
 #include "util.h"
+#include <atomic>
 #include <cstddef>
+#include <memory>
+#include <mutex>
 #include <utility>
 #include <vector>
 #include <ranges>
@@ -144,6 +147,7 @@ namespace automata {
     std::size_t AddState(bool final) {
       is_accepting_.push_back(final);
       transitions_.emplace_back();
+      OnModified();
       return GetStateNumber() - 1;
     }
 
@@ -153,6 +157,7 @@ namespace automata {
 
     void AddTransition(std::size_t from_state, std::size_t to_state, TransitionString transition_symbol) {
       transitions_[from_state].Add(Transition<TransitionString>{transition_symbol, to_state});
+      OnModified();
     }
 
     const TransitionContainer &GetTransitions(std::size_t from_state) const {
@@ -165,10 +170,12 @@ namespace automata {
 
     void SetInitialState(std::size_t initial_state) {
       initial_state_ = initial_state;
+      OnModified();
     }
 
     void SetAccepting(std::size_t state, bool accepting = true) {
       is_accepting_[state] = accepting;
+      OnModified();
     }
 
     void ReadAcceptingState(std::istream &is) {
@@ -191,9 +198,14 @@ namespace automata {
       std::ranges::sort(outgoing_transitions);
       auto to_erase = std::ranges::unique(outgoing_transitions);
       outgoing_transitions.erase(to_erase.begin(), to_erase.end());
+      OnModified();
     }
 
   protected:
+    // Called after every change of the automaton, so that derived classes can drop what they computed from it.
+    // Methods writing transitions_ directly call it themselves.
+    virtual void OnModified() {}
+
     template<typename Visitor>
     void Traverse(Visitor &&visitor) const {
       std::vector<bool> was_reached(GetStateNumber());
@@ -272,6 +284,19 @@ namespace automata {
 
   class NondeterministicAutomaton;
 
+  class NfaSimulator;
+
+  enum class RegexConstruction {
+    kThompson,
+    kGlushkov,
+    kDerivatives
+  };
+
+  enum class MinimizationAlgorithm {
+    kMoore,
+    kHopcroft
+  };
+
   class DeterministicAutomaton : public Automaton<TransitionMap> {
   public:
     using Automaton<TransitionMap>::Automaton;
@@ -282,21 +307,47 @@ namespace automata {
 
     bool AcceptsString(std::string_view string) const;
 
+    // Builds a complete DFA whose states are the distinct derivatives of the regex by words over the
+    // alphabet extended with the symbols of the regex.
+    static DeterministicAutomaton FromRegexDerivatives(const regex::Regex &input, const std::vector<char> &alphabet);
+
     DeterministicAutomaton &MakeComplete(const std::vector<char> &alphabet);
 
     DeterministicAutomaton ToComplete(const std::vector<char> &alphabet) const;
 
     DeterministicAutomaton &Complement();
 
-    DeterministicAutomaton Minimize() const;
+    // Moore's algorithm computes the signatures of states in every round on thread_number threads; the result
+    // is the same for any number of threads. Hopcroft's algorithm runs on the calling thread only, and throws
+    // std::invalid_argument for any other thread_number than 1.
+    DeterministicAutomaton Minimize(MinimizationAlgorithm algorithm = MinimizationAlgorithm::kHopcroft,
+                                    std::size_t thread_number = 1) const;
+
+    // Minimizes a complete automaton whose states carry labels: only states with the same label and
+    // acceptance are merged. On return, labels holds the labels of the states of the result.
+    DeterministicAutomaton MinimizeLabeled(std::vector<std::size_t> &labels, std::size_t thread_number = 1) const;
 
-    DeterministicAutomaton Intersection(const DeterministicAutomaton &other) const;
+    // Only pairs of states reachable from the pair of initial states are created, see ProductBuilder.
+    DeterministicAutomaton Intersection(const DeterministicAutomaton &other, std::size_t thread_number = 1) const;
 
     bool IsComplete() const;
 
     bool IsIsomorphic(const DeterministicAutomaton &other) const;
 
+    // Runs both automata in lockstep, treating missing transitions as going to an implicit sink, and merges
+    // paired states with union-find (Hopcroft-Karp). If a merged pair disagrees on acceptance, the shortest
+    // word accepted by exactly one of the automata is found by breadth-first search over pairs of states.
+    std::optional<std::string> FindDistinguishingWord(const DeterministicAutomaton &other) const;
+
     bool IsEquivalent(const DeterministicAutomaton &other) const;
+
+  private:
+    // Refines the initial partition of states given by class indexes numbered in order of their first state.
+    std::vector<std::size_t> GetMooreClasses(std::vector<std::size_t> class_indexes, std::size_t thread_number) const;
+
+    std::vector<std::size_t> GetHopcroftClasses() const;
+
+    DeterministicAutomaton BuildQuotient(std::vector<std::size_t> class_indexes) const;
   };
 
   class NondeterministicAutomaton : public Automaton<TransitionVector<std::string>> {
@@ -305,19 +356,73 @@ namespace automata {
 
     NondeterministicAutomaton(const DeterministicAutomaton &deterministic);
 
+    // Simulates the automaton without determinizing it, see NfaSimulator. The simulator is built by the first
+    // call and kept until the automaton changes, so further calls take time linear in the length of the string.
+    // Calls may run concurrently as long as the automaton is not changed meanwhile.
+    bool AcceptsString(std::string_view string) const;
+
     NondeterministicAutomaton &SplitTransitions();
 
     NondeterministicAutomaton RemoveEmptyTransitions() const;
 
-    DeterministicAutomaton DeterminizeSingleLetterTransitions() const;
+    // With more than one thread, subsets are expanded in parallel; the result does not depend on the number
+    // of threads, see SubsetConstruction.
+    DeterministicAutomaton DeterminizeSingleLetterTransitions(std::size_t thread_number = 1) const;
 
-    DeterministicAutomaton Determinize() const;
+    DeterministicAutomaton Determinize(std::size_t thread_number = 1) const;
 
-    static NondeterministicAutomaton FromRegex(const regex::Regex &input);
+    static NondeterministicAutomaton FromRegex(const regex::Regex &input,
+                                               RegexConstruction construction = RegexConstruction::kThompson);
 
-    regex::Regex ToRegex() const;
+    // Builds a regex by state elimination. Unless simplify is false, every intermediate regex is
+    // rewritten by regex::Simplifier, which keeps the output from growing exponentially.
+    regex::Regex ToRegex(bool simplify = true) const;
 
     NondeterministicAutomaton &MakeSingleAcceptingState();
+
+    // Looks for a word accepted by this automaton but not by the other one. The search runs breadth-first
+    // over pairs of a state of this automaton and a subset of states of the other one, and a pair is
+    // dropped if a pair with the same state and a smaller subset was already found (antichain pruning),
+    // so the other automaton is never fully determinized. Returns the shortest such word if any.
+    std::optional<std::string> FindInclusionCounterexample(const NondeterministicAutomaton &other) const;
+
+    bool IsSubsetOf(const NondeterministicAutomaton &other) const;
+
+    // Returns a word accepted by exactly one of the automata, or nothing if they are equivalent.
+    std::optional<std::string> FindDistinguishingWord(const NondeterministicAutomaton &other) const;
+
+    bool IsEquivalent(const NondeterministicAutomaton &other) const;
+
+  protected:
+    void OnModified() override {
+      simulator_cache_.Reset();
+    }
+
+  private:
+    // Copies share the simulator, since they accept the same strings until one of them changes.
+    class SimulatorCache {
+    public:
+      SimulatorCache() = default;
+
+      SimulatorCache(const SimulatorCache &other);
+
+      SimulatorCache &operator=(const SimulatorCache &other);
+
+      const NfaSimulator &Get(const NondeterministicAutomaton &automaton) const;
+
+      void Reset() {
+        simulator_.reset();
+        simulator_pointer_.store(nullptr, std::memory_order_relaxed);
+      }
+
+    private:
+      mutable std::mutex mutex_;
+      mutable std::shared_ptr<const NfaSimulator> simulator_;
+      // Lets built simulators be used without locking.
+      mutable std::atomic<const NfaSimulator *> simulator_pointer_ = nullptr;
+    };
+
+    SimulatorCache simulator_cache_;
   };
 
   class AutomatonVisitor : public regex::AbstractVisitor<NondeterministicAutomaton> {
@@ -340,9 +445,43 @@ namespace automata {
     static void MergeAutomatons(NondeterministicAutomaton &first, const NondeterministicAutomaton &second);
   };
 
-  DeterministicAutomaton RegexToMCDFA(const regex::Regex &expression, const std::vector<char> &alphabet);
+  struct GlushkovPositions {
+    bool is_nullable = false;
+    std::vector<std::size_t> first, last;
+  };
+
+  // Builds the position automaton of a regex: state 0 is initial and state p + 1 corresponds to the p-th
+  // literal, so the result has no empty transitions and every transition is single-letter.
+  class GlushkovVisitor : public regex::AbstractVisitor<GlushkovPositions> {
+  public:
+    GlushkovPositions Process(const regex::None &regex) override;
+
+    GlushkovPositions Process(const regex::Empty &regex) override;
+
+    GlushkovPositions Process(const regex::Literal &regex) override;
+
+    GlushkovPositions Process(const regex::Concatenation &regex, GlushkovPositions first,
+                              GlushkovPositions second) override;
+
+    GlushkovPositions Process(const regex::Alteration &regex, GlushkovPositions first,
+                              GlushkovPositions second) override;
+
+    GlushkovPositions Process(const regex::KleeneStar &regex, GlushkovPositions inner) override;
+
+    NondeterministicAutomaton GetAutomaton();
+
+  private:
+    void AddFollowers(const std::vector<std::size_t> &positions, const std::vector<std::size_t> &followers);
+
+    std::vector<char> symbols_;
+    std::vector<std::vector<std::size_t>> follow_;
+  };
+
+  DeterministicAutomaton RegexToMCDFA(const regex::Regex &expression, const std::vector<char> &alphabet,
+                                      RegexConstruction construction = RegexConstruction::kThompson);
 
-  regex::Regex RegexComplement(const regex::Regex &expression, const std::vector<char> &alphabet);
+  regex::Regex RegexComplement(const regex::Regex &expression, const std::vector<char> &alphabet,
+                               bool simplify = true);
 }
 
 #endif //AUTOMATA_AUTOMATON_H
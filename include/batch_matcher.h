@@ -0,0 +1,90 @@
+#ifndef AUTOMATA_BATCH_MATCHER_H
+#define AUTOMATA_BATCH_MATCHER_H
+
+#include "compiled_dfa.h"
+#include "parallel.h"
+#include "prefilter.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace automata {
+  // Results of a batch, one bit per string.
+  class MatchBitmap {
+  public:
+    explicit MatchBitmap(std::size_t size = 0) : size_(size), words_((size + 63) / 64) {}
+
+    std::size_t size() const {
+      return size_;
+    }
+
+    bool operator[](std::size_t index) const {
+      return (words_[index / 64] >> (index % 64)) & 1;
+    }
+
+    std::size_t GetAcceptedNumber() const;
+
+    const std::vector<std::uint64_t> &words() const {
+      return words_;
+    }
+
+  private:
+    friend class BatchMatcher;
+
+    std::size_t size_;
+    std::vector<std::uint64_t> words_;
+  };
+
+  struct BatchStatistics {
+    std::size_t batch_number = 0;
+    std::size_t string_number = 0;
+    std::size_t byte_number = 0;
+    // Strings the prefilter rejected without running the automaton.
+    std::size_t prefiltered_number = 0;
+    std::chrono::nanoseconds elapsed{0};
+
+    double GetBytesPerSecond() const;
+
+    double GetStringsPerSecond() const;
+  };
+
+  // Matches batches of strings against one compiled DFA, which may be shared with other matchers. A batch is
+  // split between threads of the ThreadPool in runs of 64 strings, so every thread writes whole words of the
+  // bitmap. The counters add up over all batches matched so far. With a prefilter, only the strings it passes
+  // are run through the automaton; the prefilter must come from the regex the automaton was built from.
+  class BatchMatcher {
+  public:
+    explicit BatchMatcher(std::shared_ptr<const CompiledDfa> dfa,
+                          std::size_t thread_number = GetDefaultThreadNumber());
+
+    BatchMatcher(std::shared_ptr<const CompiledDfa> dfa, LiteralPrefilter prefilter,
+                 std::size_t thread_number = GetDefaultThreadNumber());
+
+    MatchBitmap Match(std::span<const std::string_view> strings) const;
+
+    // The i-th string is blob[offsets[i], offsets[i + 1]). Throws InvalidInputException unless the offsets
+    // are non-decreasing and within the blob.
+    MatchBitmap Match(std::string_view blob, std::span<const std::size_t> offsets) const;
+
+    BatchStatistics GetStatistics() const;
+
+  private:
+    template<typename GetString>
+    MatchBitmap MatchStrings(std::size_t string_number, GetString &&get_string) const;
+
+    std::shared_ptr<const CompiledDfa> dfa_;
+    LiteralPrefilter prefilter_;
+    std::size_t thread_number_;
+    mutable std::atomic<std::size_t> batch_number_ = 0;
+    mutable std::atomic<std::size_t> string_number_ = 0;
+    mutable std::atomic<std::size_t> byte_number_ = 0;
+    mutable std::atomic<std::size_t> prefiltered_number_ = 0;
+    mutable std::atomic<std::int64_t> elapsed_nanoseconds_ = 0;
+  };
+}
+
+#endif //AUTOMATA_BATCH_MATCHER_H
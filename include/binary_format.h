@@ -0,0 +1,131 @@
+#ifndef AUTOMATA_BINARY_FORMAT_H
+#define AUTOMATA_BINARY_FORMAT_H
+
+#include "automaton.h"
+#include "compiled_dfa.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace automata {
+  // Binary images of automata. An image is a header followed by sections, every one of them aligned to 64
+  // bytes, so a mapped file is used in place: the transition table of a deterministic automaton is laid out
+  // exactly as CompiledDfa expects it and matching starts without copying anything. Numbers are stored in
+  // the byte order of the machine that wrote the image, which is recorded in the header.
+  inline constexpr std::uint32_t kBinaryFormatVersion = 1;
+  inline constexpr std::size_t kBinaryAlignment = 64;
+
+  enum class BinaryAutomatonKind : std::uint32_t {
+    kDeterministic = 1,
+    kNondeterministic = 2
+  };
+
+  enum class BinarySection : std::uint32_t {
+    // Bitmap of accepting states, 64 states per word.
+    kAccepting,
+    // Outgoing transitions of state s are [offsets[s], offsets[s + 1]), as 64-bit numbers.
+    kTransitionOffsets,
+    // 64-bit target state of every transition.
+    kTargets,
+    // The label of transition t is labels[label_offsets[t], label_offsets[t + 1]), as 64-bit offsets.
+    kLabelOffsets,
+    kLabels,
+    // Tables of the CompiledDfa of a deterministic automaton; empty for nondeterministic ones.
+    kCompiledTransitions,
+    kCompiledAccepting,
+    kSectionNumber
+  };
+
+  struct BinarySectionRange {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+  };
+
+  struct BinaryHeader {
+    std::array<char, 8> magic{};
+    std::uint32_t version = 0;
+    std::uint32_t byte_order = 0;
+    BinaryAutomatonKind kind{};
+    std::uint32_t reserved = 0;
+    std::uint64_t file_size = 0;
+    // Checksum of the whole image, computed with this field set to zero.
+    std::uint64_t checksum = 0;
+    std::uint64_t state_number = 0;
+    std::uint64_t initial_state = 0;
+    std::uint64_t transition_number = 0;
+    // Bitmap of the bytes that occur in transition labels.
+    std::array<std::uint64_t, 4> alphabet{};
+    std::uint64_t compiled_initial_state = 0;
+    std::array<BinarySectionRange, static_cast<std::size_t>(BinarySection::kSectionNumber)> sections{};
+    std::array<std::uint64_t, 5> padding{};
+  };
+
+  static_assert(sizeof(BinaryHeader) % kBinaryAlignment == 0);
+
+  std::vector<std::byte> ToBinary(const DeterministicAutomaton &automaton);
+
+  std::vector<std::byte> ToBinary(const NondeterministicAutomaton &automaton);
+
+  void SaveBinary(const DeterministicAutomaton &automaton, const std::string &path);
+
+  void SaveBinary(const NondeterministicAutomaton &automaton, const std::string &path);
+
+  // A read-only binary image, either mapped from a file or held in memory. The header and the section layout
+  // are always checked; verification additionally checks the checksum and every state number in the image,
+  // which takes time linear in its size. Images that were not verified must come from a trusted source, since
+  // the compiled automaton follows their transitions unchecked.
+  class MappedAutomaton {
+  public:
+    static MappedAutomaton Open(const std::string &path, bool verify = true);
+
+    static MappedAutomaton FromBuffer(std::vector<std::byte> image, bool verify = true);
+
+    const BinaryHeader &header() const {
+      return *reinterpret_cast<const BinaryHeader *>(image_.data());
+    }
+
+    BinaryAutomatonKind kind() const {
+      return header().kind;
+    }
+
+    std::size_t GetStateNumber() const {
+      return header().state_number;
+    }
+
+    bool IsAccepting(std::size_t state) const;
+
+    // Targets and labels of the outgoing transitions of a state, without copying.
+    std::span<const std::uint64_t> GetTargets(std::size_t state) const;
+
+    std::string_view GetLabel(std::size_t transition) const;
+
+    DeterministicAutomaton ToDeterministic() const;
+
+    NondeterministicAutomaton ToNondeterministic() const;
+
+    // Shares the mapping instead of copying the tables.
+    CompiledDfa GetCompiledDfa() const;
+
+  private:
+    MappedAutomaton(std::shared_ptr<const void> storage, std::span<const std::byte> image, bool verify);
+
+    template<typename T>
+    std::span<const T> GetSection(BinarySection section) const;
+
+    void CheckLayout() const;
+
+    void Verify() const;
+
+    std::shared_ptr<const void> storage_;
+    std::span<const std::byte> image_;
+  };
+
+  std::uint64_t ComputeBinaryChecksum(std::span<const std::byte> image);
+}
+
+#endif //AUTOMATA_BINARY_FORMAT_H
@@ -2,9 +2,14 @@
 #define AUTOMATA_CLI_H
 
 #include <variant>
+#include <fstream>
 #include <iostream>
 #include "automaton.h"
+#include "binary_format.h"
 #include "regex.h"
+#include "statistics.h"
+#include "text_format.h"
+#include "trace.h"
 
 namespace cli {
   using Object = std::variant<automata::NondeterministicAutomaton, automata::DeterministicAutomaton, regex::Regex>;
@@ -83,6 +88,21 @@ namespace cli {
       }
     };
 
+    // Reads an automaton in the text format from a file.
+    class CreateFromFile : public Command {
+    public:
+      CreateFromFile(CLI &cli, std::istream &args) : Command(cli, args) {
+        args >> path_;
+      }
+
+      void Execute() override {
+        cli_.AddObject(automata::LoadText<automata::NondeterministicAutomaton>(path_));
+      }
+
+    private:
+      std::string path_;
+    };
+
     template<typename T>
     class OnObject : public Command {
     public:
@@ -255,10 +275,109 @@ namespace cli {
       using OnObjects::OnObjects;
 
       void Execute() override {
-        if (!ToDfa(*first_).IsEquivalent(ToDfa(*second_)))
-          std::cout << "not ";
-        std::cout << "equivalent" << std::endl;
+        auto word = ToDfa(*first_).FindDistinguishingWord(ToDfa(*second_));
+        if (word) {
+          std::cout << "not equivalent: \"" << *word << "\" is accepted by exactly one of them" << std::endl;
+        } else {
+          std::cout << "equivalent" << std::endl;
+        }
+      }
+    };
+
+    // Writes an automaton to a binary image file.
+    class Save : public OnObject<Object> {
+    public:
+      Save(CLI &cli, std::istream &args) : OnObject<Object>(cli, args) {
+        args >> path_;
+      }
+
+      void Execute() override {
+        std::visit([this](auto &&object) {
+          using T = std::decay_t<decltype(object)>;
+          if constexpr(std::is_same_v<T, regex::Regex>) {
+            throw InvalidInputException("Only automata can be saved");
+          } else {
+            automata::SaveBinary(object, path_);
+          }
+        }, *object_);
+      }
+
+    private:
+      std::string path_;
+    };
+
+    class Load : public Command {
+    public:
+      Load(CLI &cli, std::istream &args) : Command(cli, args) {
+        args >> path_;
+      }
+
+      void Execute() override {
+        auto image = automata::MappedAutomaton::Open(path_);
+        if (image.kind() == automata::BinaryAutomatonKind::kDeterministic) {
+          cli_.AddObject(image.ToDeterministic());
+        } else {
+          cli_.AddObject(image.ToNondeterministic());
+        }
+      }
+
+    private:
+      std::string path_;
+    };
+
+    // Prints the counters of the algorithms, or resets them with "stats reset".
+    class Stats : public Command {
+    public:
+      Stats(CLI &cli, std::istream &args) : Command(cli, args) {
+        args >> action_;
       }
+
+      void Execute() override {
+        if (action_ == "reset") {
+          automata::ResetStatistics();
+          return;
+        }
+        if (!action_.empty()) {
+          throw InvalidInputException("Unknown action " + action_);
+        }
+        auto statistics = automata::GetStatistics();
+        for (std::size_t i = 0; i < automata::kCounterNumber; ++i) {
+          auto counter = static_cast<automata::Counter>(i);
+          std::cout << automata::GetCounterName(counter) << ": " << statistics[counter] << '\n';
+        }
+      }
+
+    private:
+      std::string action_;
+    };
+
+    // Turns recording of timing spans on or off with "trace on" and "trace off", forgets the recorded spans
+    // with "trace clear" and writes them for chrome://tracing with "trace dump <file>".
+    class Trace : public Command {
+    public:
+      Trace(CLI &cli, std::istream &args) : Command(cli, args) {
+        args >> action_ >> path_;
+      }
+
+      void Execute() override {
+        if (action_ == "on" || action_ == "off") {
+          automata::SetTracingEnabled(action_ == "on");
+        } else if (action_ == "clear") {
+          automata::ClearTrace();
+        } else if (action_ == "dump") {
+          std::ofstream file(path_);
+          if (!file) {
+            throw InvalidInputException("Cannot open " + path_);
+          }
+          automata::WriteChromeTrace(file);
+        } else {
+          throw InvalidInputException("Unknown action " + action_);
+        }
+      }
+
+    private:
+      std::string action_;
+      std::string path_;
     };
 
     class AbstractCommandHandle {
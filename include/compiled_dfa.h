@@ -0,0 +1,94 @@
+#ifndef AUTOMATA_COMPILED_DFA_H
+#define AUTOMATA_COMPILED_DFA_H
+
+#include "automaton.h"
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace automata {
+  // Immutable table-driven form of a DeterministicAutomaton. Transitions are stored in a flat row-major
+  // table with one row per state and one column per byte value. Missing transitions, and transitions to
+  // states from which no accepting state is reachable, lead to an explicit non-accepting dead state, so
+  // matching needs no branches besides the loop itself. The tables are immutable and shared between copies;
+  // they may also live in memory owned by someone else, such as a mapped file.
+  class CompiledDfa {
+  public:
+    using State = std::uint32_t;
+
+    // Implementations of AcceptsInterleaved. kAvx2 falls back to kScalar if the CPU does not support AVX2 or
+    // the table or a string is too large for its 32-bit indices.
+    enum class Kernel {
+      kScalar,
+      kAvx2
+    };
+
+    static constexpr std::size_t kAlphabetSize = 256;
+    static constexpr State kDeadState = 0;
+    static constexpr std::size_t kMaxInterleavedStrings = 64;
+
+    explicit CompiledDfa(const DeterministicAutomaton &automaton);
+
+    // Uses the given tables in place. Storage is kept alive as long as the automaton or any of its copies; the
+    // transitions are not checked, see HasValidTransitions.
+    CompiledDfa(std::span<const State> transitions, std::span<const std::uint64_t> is_accepting,
+                State initial_state, std::shared_ptr<const void> storage);
+
+    std::size_t GetStateNumber() const {
+      return transitions_.size() / kAlphabetSize;
+    }
+
+    State initial_state() const {
+      return initial_state_;
+    }
+
+    bool IsAccepting(State state) const {
+      return (is_accepting_[state / 64] >> (state % 64)) & 1;
+    }
+
+    State GetNextState(State state, char symbol) const {
+      return transitions_[state * kAlphabetSize + static_cast<unsigned char>(symbol)];
+    }
+
+    State Run(State state, std::string_view string) const;
+
+    State Run(std::string_view string) const {
+      return Run(initial_state_, string);
+    }
+
+    bool Accepts(std::string_view string) const {
+      return IsAccepting(Run(string));
+    }
+
+    // Returns a mask whose i-th bit tells whether strings[i] is accepted, for at most kMaxInterleavedStrings
+    // strings. The strings are run through the table in lockstep, so the dependent loads of different strings
+    // overlap instead of waiting for each other: kScalar runs groups of 8 strings one after another, and
+    // kAvx2 runs all of them at once with gathers. Both stop as soon as every string is finished or dead.
+    std::uint64_t AcceptsInterleaved(const std::string_view *strings, std::size_t count,
+                                     Kernel kernel = GetBestKernel()) const;
+
+    // Detected once at run time.
+    static Kernel GetBestKernel();
+
+    // Whether every transition leads to an existing state.
+    bool HasValidTransitions() const;
+
+    std::span<const State> transitions() const {
+      return transitions_;
+    }
+
+    std::span<const std::uint64_t> is_accepting() const {
+      return is_accepting_;
+    }
+
+  private:
+    std::span<const State> transitions_;
+    std::span<const std::uint64_t> is_accepting_;
+    State initial_state_;
+    std::shared_ptr<const void> storage_;
+  };
+}
+
+#endif //AUTOMATA_COMPILED_DFA_H
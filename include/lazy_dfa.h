@@ -0,0 +1,52 @@
+#ifndef AUTOMATA_LAZY_DFA_H
+#define AUTOMATA_LAZY_DFA_H
+
+#include "automaton.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace automata {
+  // Matcher that determinizes an epsilon-free NFA on demand: a subset state and its outgoing transitions are
+  // built only when some input reaches them. Built states live in a cache shared by all threads. Reading
+  // cached transitions takes no locks; adding a state takes a mutex. When the cache exceeds the memory limit,
+  // it is dropped and matching continues in a fresh one.
+  class LazyDfa {
+  public:
+    static constexpr std::size_t kDefaultMemoryLimit = 64 << 20;
+
+    explicit LazyDfa(const NondeterministicAutomaton &automaton, std::size_t memory_limit = kDefaultMemoryLimit);
+
+    ~LazyDfa();
+
+    bool AcceptsString(std::string_view string) const;
+
+    std::size_t GetCachedStateNumber() const;
+
+    std::size_t GetCacheFlushNumber() const {
+      return cache_flush_number_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct CachedState;
+    struct Cache;
+
+    const CachedState *AddTransition(std::shared_ptr<Cache> &cache, const CachedState *state, char symbol) const;
+
+    const CachedState *GetOrAddState(Cache &cache, std::vector<std::size_t> subset) const;
+
+    std::shared_ptr<Cache> CreateCache() const;
+
+    std::size_t initial_state_;
+    std::vector<bool> is_accepting_;
+    std::vector<std::vector<Transition<char>>> transitions_;
+    std::size_t memory_limit_;
+    mutable std::atomic<std::shared_ptr<Cache>> cache_;
+    mutable std::atomic<std::size_t> cache_flush_number_ = 0;
+    mutable std::mutex mutex_;
+  };
+}
+
+#endif //AUTOMATA_LAZY_DFA_H
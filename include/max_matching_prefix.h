@@ -17,6 +17,7 @@ private:
   std::vector<std::vector<bool>> is_possible_prefix_;
   std::queue<std::pair<std::size_t, std::size_t>> to_process_;
   std::size_t max_matching_prefix_ = 0;
+  std::size_t queue_push_number_ = 0;
 
   std::size_t ComputeMaxMatchingPrefix();
 
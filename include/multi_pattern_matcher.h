@@ -0,0 +1,47 @@
+#ifndef AUTOMATA_MULTI_PATTERN_MATCHER_H
+#define AUTOMATA_MULTI_PATTERN_MATCHER_H
+
+#include "compiled_dfa.h"
+#include "regex.h"
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace automata {
+  // Matches strings against many regexes in one pass. The Glushkov automata of the patterns share their initial
+  // state, the union is determinized once, and every state of the result is tagged with the set of patterns
+  // accepting there. Minimization merges only states with equal sets of patterns.
+  class MultiPatternMatcher {
+  public:
+    explicit MultiPatternMatcher(const std::vector<regex::Regex> &patterns, std::size_t thread_number = 1);
+
+    // Returns the indices of the patterns matching the whole string in increasing order.
+    const std::vector<std::size_t> &Match(std::string_view string) const {
+      return GetMatchedPatterns(dfa_->Run(string));
+    }
+
+    // Returns the indices of the patterns accepting in a state of the compiled DFA, e.g. one reached by a
+    // StreamMatcher.
+    const std::vector<std::size_t> &GetMatchedPatterns(CompiledDfa::State state) const {
+      return pattern_sets_[pattern_set_indices_[state]];
+    }
+
+    std::size_t GetPatternNumber() const {
+      return pattern_number_;
+    }
+
+    std::shared_ptr<const CompiledDfa> dfa() const {
+      return dfa_;
+    }
+
+  private:
+    std::size_t pattern_number_;
+    std::shared_ptr<const CompiledDfa> dfa_;
+    // Distinct sets of patterns accepting in some state; the first one is empty.
+    std::vector<std::vector<std::size_t>> pattern_sets_;
+    // Index in pattern_sets_ for every state of the compiled DFA.
+    std::vector<std::size_t> pattern_set_indices_;
+  };
+}
+
+#endif //AUTOMATA_MULTI_PATTERN_MATCHER_H
@@ -0,0 +1,40 @@
+#ifndef AUTOMATA_NFA_SIMULATOR_H
+#define AUTOMATA_NFA_SIMULATOR_H
+
+#include "automaton.h"
+#include <memory>
+#include <string_view>
+
+namespace automata {
+  // Matches strings against an NFA directly, keeping the set of active states as a packed bitset.
+  // Small automata whose epsilon-free form has at most kMaxBitParallelStates states use a Glushkov-style
+  // engine: every state is entered by a single symbol, so a step is a table-driven union of follow sets
+  // masked by the states entered by the current symbol. Other automata with at most kMaxDenseStates states
+  // use a generic engine that ORs precomputed successor masks, already closed under empty transitions, of
+  // the active states. Larger automata, for which the masks would take quadratic memory, keep the same
+  // successors as lists of states instead.
+  //
+  // Building a simulator takes time and memory superlinear in the size of the automaton, while matching is
+  // linear in the length of the string, so a simulator should be built once and reused for many strings.
+  // It is immutable once built and can be shared by threads.
+  class NfaSimulator {
+  public:
+    static constexpr std::size_t kMaxBitParallelStates = 256;
+    static constexpr std::size_t kMaxDenseStates = 4096;
+
+    explicit NfaSimulator(const NondeterministicAutomaton &automaton);
+
+    ~NfaSimulator();
+
+    bool AcceptsString(std::string_view string) const;
+
+    bool IsBitParallel() const;
+
+    class Engine;
+
+  private:
+    std::unique_ptr<Engine> engine_;
+  };
+}
+
+#endif //AUTOMATA_NFA_SIMULATOR_H
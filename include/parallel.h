@@ -0,0 +1,68 @@
+#ifndef AUTOMATA_PARALLEL_H
+#define AUTOMATA_PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace automata {
+  inline std::size_t GetDefaultThreadNumber() {
+    return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  // Number of chunks ParallelFor splits a range of the given size into.
+  inline std::size_t GetChunkNumber(std::size_t size, std::size_t thread_number, std::size_t min_chunk_size = 1) {
+    return std::max<std::size_t>(std::min(thread_number, size / std::max<std::size_t>(min_chunk_size, 1)), 1);
+  }
+
+  // Process-wide threads that outlive the calls running on them. A task goes to an idle thread, and a new
+  // thread is started only when all of them are busy, so the tasks of one call always run at once: they may
+  // wait for each other or call Run themselves without deadlocking. The pool is never destroyed, and its
+  // idle threads simply end with the process.
+  class ThreadPool {
+  public:
+    static ThreadPool &Get();
+
+    // Calls run(context, task) for every task in [0, task_number), task 0 on the calling thread and the rest
+    // on threads of the pool, and returns once all of them are done.
+    void Run(std::size_t task_number, void (*run)(void *, std::size_t), void *context);
+
+    // Threads started so far, busy or idle.
+    std::size_t GetThreadNumber() const;
+
+  private:
+    struct TaskGroup;
+    struct Worker;
+
+    ThreadPool() = default;
+
+    void Work(Worker &worker);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<Worker *> idle_workers_;
+  };
+
+  // Splits [0, size) into GetChunkNumber contiguous chunks and calls function(begin, end, chunk) for each of
+  // them, the first one on the calling thread and the rest on threads of the ThreadPool. Chunks go in order
+  // of their ranges, so per-chunk results concatenated by chunk index come out in order of the range.
+  template<typename F>
+  void ParallelFor(std::size_t size, std::size_t thread_number, F &&function, std::size_t min_chunk_size = 1) {
+    auto chunk_number = GetChunkNumber(size, thread_number, min_chunk_size);
+    auto run_chunk = [&function, size, chunk_number](std::size_t chunk) {
+      function(size * chunk / chunk_number, size * (chunk + 1) / chunk_number, chunk);
+    };
+    if (chunk_number == 1) {
+      run_chunk(0);
+      return;
+    }
+    ThreadPool::Get().Run(chunk_number, [](void *context, std::size_t chunk) {
+      (*static_cast<decltype(run_chunk) *>(context))(chunk);
+    }, &run_chunk);
+  }
+}
+
+#endif //AUTOMATA_PARALLEL_H
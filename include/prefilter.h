@@ -0,0 +1,74 @@
+#ifndef AUTOMATA_PREFILTER_H
+#define AUTOMATA_PREFILTER_H
+
+#include "regex.h"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace automata {
+  struct LiteralFactors {
+    // The whole language, if it is a small finite set of strings.
+    std::optional<std::vector<std::string>> exact;
+    // Every word of the language starts with, ends with and contains at least one of these strings
+    // respectively. An empty string among them means nothing is known; no strings at all means the language
+    // is empty.
+    std::vector<std::string> prefixes{""};
+    std::vector<std::string> suffixes{""};
+    std::vector<std::string> required{""};
+  };
+
+  // Extracts literal factors bottom-up: finite parts of the regex are kept as exact sets as long as they stay
+  // small, a concatenation requires the best of the factors of its operands and of the suffixes of the first
+  // one joined with the prefixes of the second one, and an alteration requires any of the factors of its
+  // alternatives.
+  class RequiredLiteralVisitor : public regex::AbstractVisitor<LiteralFactors> {
+  public:
+    LiteralFactors Process(const regex::None &regex) override;
+
+    LiteralFactors Process(const regex::Empty &regex) override;
+
+    LiteralFactors Process(const regex::Literal &regex) override;
+
+    LiteralFactors Process(const regex::Concatenation &regex, LiteralFactors first, LiteralFactors second) override;
+
+    LiteralFactors Process(const regex::Alteration &regex, LiteralFactors first, LiteralFactors second) override;
+
+    LiteralFactors Process(const regex::KleeneStar &regex, LiteralFactors inner) override;
+  };
+
+  // Returns strings such that every word of the language contains at least one of them, or {""} if there are
+  // none worth searching for.
+  std::vector<std::string> GetRequiredLiterals(const regex::Regex &expression);
+
+  // Rejects strings that contain none of the required literals of a regex before they reach an automaton.
+  // The literals are looked up with memchr on their first byte, so a string without candidates is rejected
+  // at the speed of memchr without touching a transition table. MayMatch never rejects a string of the
+  // language, so matching only the strings it passes gives exactly the same results.
+  class LiteralPrefilter {
+  public:
+    // A prefilter that passes everything.
+    LiteralPrefilter() = default;
+
+    explicit LiteralPrefilter(std::vector<std::string> literals);
+
+    explicit LiteralPrefilter(const regex::Regex &expression);
+
+    bool MayMatch(std::string_view string) const;
+
+    bool PassesEverything() const {
+      return passes_everything_;
+    }
+
+    const std::vector<std::string> &literals() const {
+      return literals_;
+    }
+
+  private:
+    std::vector<std::string> literals_;
+    bool passes_everything_ = true;
+  };
+}
+
+#endif //AUTOMATA_PREFILTER_H
@@ -0,0 +1,31 @@
+#ifndef AUTOMATA_PRODUCT_H
+#define AUTOMATA_PRODUCT_H
+
+#include "automaton.h"
+#include <vector>
+
+namespace automata {
+  // Builds the product of several DFAs, i.e. a DFA accepting the intersection of their languages. Only tuples
+  // of states reachable from the tuple of initial states are created. With more than one thread, the
+  // breadth-first search splits every large enough level of the frontier between threads, while tuples are
+  // interned on the calling thread. Tuples are numbered in order of discovery, so the result does not depend
+  // on the number of threads.
+  class ProductBuilder {
+  public:
+    explicit ProductBuilder(std::vector<const DeterministicAutomaton *> automata, std::size_t thread_number = 1);
+
+    DeterministicAutomaton Build() const;
+
+    // Stops as soon as an accepting tuple is reached, without building the product.
+    bool IsEmpty() const;
+
+  private:
+    // Returns whether an accepting tuple is reachable. If result is null, stops at the first one found.
+    bool Explore(DeterministicAutomaton *result) const;
+
+    std::vector<const DeterministicAutomaton *> automata_;
+    std::size_t thread_number_;
+  };
+}
+
+#endif //AUTOMATA_PRODUCT_H
@@ -8,6 +8,12 @@
 #include <span>
 #include <ranges>
 #include <algorithm>
+#include <vector>
+#include <cstddef>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace regex {
   class RegexNode;
@@ -26,7 +32,12 @@ namespace regex {
 
   class KleeneStar;
 
-  using RegexPtr = std::shared_ptr<RegexNode>;
+  class NodeStore;
+
+  class Regex;
+
+  // Nodes are immutable and owned by the NodeStore that interned them; a Regex keeps its store alive.
+  using RegexPtr = const RegexNode *;
 
   class Visitor {
   public:
@@ -55,44 +66,84 @@ namespace regex {
     virtual void Exit(const KleeneStar &regex) {}
   };
 
+  // Tells the type of a node without RTTI, so interning and rewriting can compare and downcast nodes cheaply.
+  enum class NodeKind {
+    kNone,
+    kEmpty,
+    kLiteral,
+    kConcatenation,
+    kAlteration,
+    kKleeneStar
+  };
+
   class RegexNode {
   public:
-    explicit RegexNode(std::size_t priority) : priority_(priority) {}
+    RegexNode(std::size_t priority, NodeKind kind) : priority_(priority), kind_(kind) {}
 
     virtual ~RegexNode() = default;
 
     virtual void Print(std::ostream &os) const = 0;
 
-    virtual bool IsNone() {
+    NodeKind kind() const {
+      return kind_;
+    }
+
+    virtual bool IsNone() const {
       return false;
     }
 
-    virtual bool IsEmpty() {
+    virtual bool IsEmpty() const {
       return false;
     }
 
     void Print(std::size_t outer_priority, std::ostream &os) const;
 
-    virtual void Enter(Visitor &visitor) = 0;
+    virtual void Enter(Visitor &visitor) const = 0;
+
+    virtual void Exit(Visitor &visitor) const = 0;
 
-    virtual void Exit(Visitor &visitor) = 0;
+    virtual std::span<const RegexPtr> children() const = 0;
 
-    virtual std::span<RegexPtr> children() = 0;
+    // Compares the type and data of the nodes, ignoring their children.
+    virtual bool IsSameData(const RegexNode &other) const = 0;
+
+    // Compares the type and data of the nodes; children are compared by identity.
+    bool IsSameNode(const RegexNode &other) const {
+      return IsSameData(other) && std::ranges::equal(children(), other.children());
+    }
+
+    virtual std::size_t ComputeHash() const = 0;
+
+    // Interns a node with the type and data of this one and the given children, which belong to the store.
+    virtual RegexPtr CopyTo(NodeStore &store, std::span<const RegexPtr> children) const = 0;
+
+    // Structural: equal for structurally equal nodes of different stores.
+    std::size_t hash() const {
+      return hash_;
+    }
 
     std::size_t priority_;
+
+  private:
+    friend class NodeStore;
+
+    NodeKind kind_;
+    std::size_t hash_ = 0;
+    NodeStore *store_ = nullptr;
   };
 
   template<typename T, std::size_t ChildrenCount>
   class BaseRegex : public RegexNode {
   public:
     template<typename ... Children>
-    BaseRegex(std::size_t priority, Children... children) : RegexNode(priority), children_{std::move(children)...} {}
+    BaseRegex(std::size_t priority, Children... children) :
+        RegexNode(priority, T::kKind), children_{std::move(children)...} {}
 
-    void Enter(Visitor &visitor) override {
+    void Enter(Visitor &visitor) const override {
       visitor.Enter(static_cast<const T &>(*this));
     }
 
-    void Exit(Visitor &visitor) override {
+    void Exit(Visitor &visitor) const override {
       visitor.Exit(static_cast<const T &>(*this));
     }
 
@@ -100,16 +151,94 @@ namespace regex {
       return *children_[child_index];
     }
 
-    std::span<RegexPtr> children() override {
+    std::span<const RegexPtr> children() const override {
       return {children_, ChildrenCount};
     }
 
+    bool IsSameData(const RegexNode &other) const override {
+      return other.kind() == T::kKind &&
+             static_cast<const T &>(*this).HasSameData(static_cast<const T &>(other));
+    }
+
+    std::size_t ComputeHash() const override {
+      auto hash = (static_cast<std::size_t>(T::kKind) << 8) ^ static_cast<const T &>(*this).GetDataHash();
+      for (auto child: children()) {
+        hash ^= child->hash() + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+      }
+      return hash;
+    }
+
+    RegexPtr CopyTo(NodeStore &store, std::span<const RegexPtr> children) const override;
+
+    bool HasSameData(const T &other) const {
+      return true;
+    }
+
+    std::size_t GetDataHash() const {
+      return 0;
+    }
+
     RegexPtr children_[ChildrenCount];
   };
 
+  // Interns regex nodes: structurally equal nodes created through the same store are the same object, so
+  // comparing them is a pointer comparison. Nodes are placed in an arena and freed together with the store,
+  // which is shared by the regexes built from its nodes. Creating nodes is thread-safe.
+  class NodeStore {
+  public:
+    NodeStore() = default;
+
+    NodeStore(const NodeStore &) = delete;
+
+    NodeStore &operator=(const NodeStore &) = delete;
+
+    ~NodeStore();
+
+    // Children of another store are imported.
+    template<typename T, typename... Args>
+    RegexPtr Create(Args &&... args);
+
+    // Returns the node of this store that is structurally equal to the given one. Subexpressions shared
+    // by the given node are copied once.
+    RegexPtr Import(RegexPtr node);
+
+    std::size_t GetNodeNumber() const;
+
+  private:
+    // Chunks grow geometrically, so a store of a few nodes stays small.
+    static constexpr std::size_t kMinChunkSize = 256;
+    static constexpr std::size_t kMaxChunkSize = 64 << 10;
+
+    struct NodeHash {
+      std::size_t operator()(RegexPtr node) const {
+        return node->hash();
+      }
+    };
+
+    struct NodeEqual {
+      bool operator()(RegexPtr first, RegexPtr second) const {
+        return first->hash() == second->hash() && first->IsSameNode(*second);
+      }
+    };
+
+    template<typename T>
+    RegexPtr Intern(T candidate);
+
+    RegexPtr Import(RegexPtr node, std::unordered_map<RegexPtr, RegexPtr> &imported);
+
+    void *Allocate(std::size_t size, std::size_t alignment);
+
+    std::unordered_set<RegexPtr, NodeHash, NodeEqual> nodes_;
+    std::vector<std::unique_ptr<std::byte[]>> chunks_;
+    std::size_t chunk_size_ = 0;
+    std::size_t chunk_used_ = 0;
+    mutable std::mutex mutex_;
+  };
+
   class Regex {
   public:
-    Regex(RegexPtr root_node) : root_node_(root_node) {}
+    // The root node belongs to the store.
+    Regex(std::shared_ptr<NodeStore> store, RegexPtr root_node) : store_(std::move(store)), root_node_(root_node) {}
 
     Regex();
 
@@ -132,6 +261,25 @@ namespace regex {
       }
     }
 
+    const RegexNode &root() const {
+      return *root_node_;
+    }
+
+    NodeStore &store() const {
+      return *store_;
+    }
+
+    const std::shared_ptr<NodeStore> &shared_store() const {
+      return store_;
+    }
+
+    // Returns a structurally equal regex whose nodes belong to the given store.
+    Regex ImportTo(std::shared_ptr<NodeStore> store) const;
+
+    // Structural equality, in O(1) for regexes of the same store and otherwise in time linear in the number
+    // of distinct subexpressions. Unlike operator==, it does not compare languages.
+    bool IsIdentical(const Regex &other) const;
+
     Regex Iterate();
 
     Regex operator+(const Regex &other) const;
@@ -144,6 +292,8 @@ namespace regex {
 
     bool operator==(const Regex &other) const;
 
+    Regex Simplify() const;
+
     void Print(std::ostream &os) const {
       root_node_->Print(os);
     }
@@ -154,11 +304,13 @@ namespace regex {
       return os.str();
     }
 
-    static Regex Parse(const std::string &input);
+    static Regex Parse(const std::string &input, std::shared_ptr<NodeStore> store = std::make_shared<NodeStore>());
 
-    static Regex ParseReversePolish(const std::string &input);
+    static Regex ParseReversePolish(const std::string &input,
+                                    std::shared_ptr<NodeStore> store = std::make_shared<NodeStore>());
 
   private:
+    std::shared_ptr<NodeStore> store_;
     RegexPtr root_node_;
   };
 
@@ -167,9 +319,11 @@ namespace regex {
   std::ostream &operator<<(std::ostream &os, const Regex &expression);
 
   struct None : public BaseRegex<None, 0> {
+    static constexpr NodeKind kKind = NodeKind::kNone;
+
     None() : BaseRegex(2) {}
 
-    bool IsNone() override {
+    bool IsNone() const override {
       return true;
     }
 
@@ -177,9 +331,11 @@ namespace regex {
   };
 
   struct Empty : public BaseRegex<Empty, 0> {
+    static constexpr NodeKind kKind = NodeKind::kEmpty;
+
     Empty() : BaseRegex(2) {}
 
-    bool IsEmpty() override {
+    bool IsEmpty() const override {
       return true;
     }
 
@@ -187,41 +343,152 @@ namespace regex {
   };
 
   struct Literal : public BaseRegex<Literal, 0> {
+    static constexpr NodeKind kKind = NodeKind::kLiteral;
+
     explicit Literal(char symbol) : BaseRegex(2), symbol(symbol) {}
 
     void Print(std::ostream &os) const override;
 
+    bool HasSameData(const Literal &other) const {
+      return symbol == other.symbol;
+    }
+
+    std::size_t GetDataHash() const {
+      return static_cast<unsigned char>(symbol);
+    }
+
     char symbol;
   };
 
   struct Concatenation : public BaseRegex<Concatenation, 2> {
+    static constexpr NodeKind kKind = NodeKind::kConcatenation;
+
     Concatenation(RegexPtr first, RegexPtr second) : BaseRegex(1, std::move(first), std::move(second)) {}
 
     void Print(std::ostream &os) const override;
   };
 
   struct Alteration : public BaseRegex<Alteration, 2> {
+    static constexpr NodeKind kKind = NodeKind::kAlteration;
+
     Alteration(RegexPtr first, RegexPtr second) : BaseRegex(0, std::move(first), std::move(second)) {}
 
     void Print(std::ostream &os) const override;
   };
 
   struct KleeneStar : public BaseRegex<KleeneStar, 1> {
+    static constexpr NodeKind kKind = NodeKind::kKleeneStar;
+
     explicit KleeneStar(RegexPtr inner) : BaseRegex(2, std::move(inner)) {}
 
     void Print(std::ostream &os) const override;
   };
 
+  // Rewrites regexes into smaller equivalent ones using algebraic identities: alternatives are flattened, sorted
+  // and deduplicated, stars absorb the terms they contain, nested stars collapse and common prefixes and
+  // suffixes of alternatives are factored out. Add, Multiply and Iterate expect already simplified arguments,
+  // so they can be used as simplifying replacements of operator+, operator* and Regex::Iterate. Arguments are
+  // imported into the store of the simplifier, which also holds every intermediate result.
+  class Simplifier {
+  public:
+    explicit Simplifier(std::shared_ptr<NodeStore> store = std::make_shared<NodeStore>()) : store_(std::move(store)) {}
+
+    Regex Simplify(const Regex &expression);
+
+    Regex Add(const Regex &first, const Regex &second);
+
+    Regex Multiply(const Regex &first, const Regex &second);
+
+    Regex Iterate(const Regex &inner);
+
+  private:
+    RegexPtr SimplifyNode(RegexPtr node);
+
+    RegexPtr Alternate(std::vector<RegexPtr> terms);
+
+    RegexPtr Concatenate(std::vector<RegexPtr> factors);
+
+    RegexPtr IterateNode(RegexPtr inner);
+
+    std::vector<RegexPtr> FactorOut(std::vector<RegexPtr> terms, bool prefixes);
+
+    bool IsLess(RegexPtr first, RegexPtr second);
+
+    bool IsNullable(RegexPtr node);
+
+    std::size_t GetSize(RegexPtr node);
+
+    // Memoized results are keyed by nodes of the store, which the simplifier keeps alive.
+    std::shared_ptr<NodeStore> store_;
+    std::unordered_map<RegexPtr, RegexPtr> simplified_;
+    std::unordered_map<RegexPtr, bool> is_nullable_;
+    std::unordered_map<RegexPtr, std::size_t> size_;
+  };
+
+  // Computes Brzozowski derivatives. Results are normalized modulo associativity, commutativity and
+  // idempotence of alternation, so a regex has finitely many distinct iterated derivatives, and memoized
+  // per node, so shared subexpressions are differentiated once. Expressions are imported into the store of the
+  // builder, which also holds the derivatives.
+  class DerivativeBuilder {
+  public:
+    explicit DerivativeBuilder(std::shared_ptr<NodeStore> store = std::make_shared<NodeStore>()) :
+        store_(std::move(store)) {}
+
+    Regex GetDerivative(const Regex &expression, char symbol);
+
+    bool IsNullable(const Regex &expression);
+
+  private:
+    RegexPtr GetDerivative(RegexPtr node, char symbol);
+
+    bool IsNullable(RegexPtr node);
+
+    RegexPtr Unite(RegexPtr first, RegexPtr second);
+
+    RegexPtr Concatenate(RegexPtr first, RegexPtr second);
+
+    std::shared_ptr<NodeStore> store_;
+    std::map<std::pair<RegexPtr, char>, RegexPtr> derivatives_;
+    std::unordered_map<RegexPtr, bool> is_nullable_;
+  };
+
+  template<typename T>
+  RegexPtr NodeStore::Intern(T candidate) {
+    std::unordered_map<RegexPtr, RegexPtr> imported;
+    for (auto &child: candidate.children_) {
+      child = Import(child, imported);
+    }
+    candidate.hash_ = candidate.ComputeHash();
+    std::lock_guard lock(mutex_);
+    auto it = nodes_.find(&candidate);
+    if (it != nodes_.end()) {
+      return *it;
+    }
+    auto node = new(Allocate(sizeof(T), alignof(T))) T(std::move(candidate));
+    node->store_ = this;
+    nodes_.insert(node);
+    return node;
+  }
+
   template<typename T, typename... Args>
-  Regex Create(Args &&... args) {
-    return {std::make_shared<T>(std::forward<Args>(args)...)};
+  RegexPtr NodeStore::Create(Args &&... args) {
+    return Intern(T(std::forward<Args>(args)...));
   }
 
-  template<>
-  Regex Create<None>();
+  template<typename T, std::size_t ChildrenCount>
+  RegexPtr BaseRegex<T, ChildrenCount>::CopyTo(NodeStore &store, std::span<const RegexPtr> children) const {
+    T copy = static_cast<const T &>(*this);
+    std::ranges::copy(children, copy.children_);
+    return store.Create<T>(std::move(copy));
+  }
 
-  template<>
-  Regex Create<Empty>();
+  // Creates a regex of a single node in a new store.
+  template<typename T, typename... Args>
+  Regex Create(Args &&... args) {
+    auto store = std::make_shared<NodeStore>();
+    auto node = store->Create<T>(std::forward<Args>(args)...);
+    return {std::move(store), node};
+  }
 
   template<typename T>
   class AbstractVisitor : public Visitor {
@@ -0,0 +1,65 @@
+#ifndef AUTOMATA_STATISTICS_H
+#define AUTOMATA_STATISTICS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace automata {
+  // Process-wide counters of the work done inside the algorithms, to tell which stage of a slow construction
+  // blew up. Algorithms add to them once per call or per round, never per state, so they cost nothing
+  // measurable; building with AUTOMATA_DISABLE_STATISTICS defined removes them altogether, and then all of
+  // them read 0.
+  enum class Counter {
+    // Subset construction: subsets created, and subsets looked up that already existed.
+    kSubsetsCreated,
+    kSubsetHashHits,
+    // Minimization: rounds of Moore's algorithm or splitters processed by Hopcroft's, and the number of
+    // blocks of the final partition.
+    kMinimizationRounds,
+    kMinimizationBlocks,
+    kEmptyTransitionsRemoved,
+    // Product construction: tuples of states reached.
+    kProductTuples,
+    // MaxMatchingPrefixFinder: pairs of a state and a prefix length put in the queue.
+    kPrefixQueuePushes,
+    kCounterNumber
+  };
+
+  inline constexpr std::size_t kCounterNumber = static_cast<std::size_t>(Counter::kCounterNumber);
+
+  std::string_view GetCounterName(Counter counter);
+
+  class Statistics {
+  public:
+    std::uint64_t operator[](Counter counter) const {
+      return values_[static_cast<std::size_t>(counter)];
+    }
+
+    std::uint64_t &operator[](Counter counter) {
+      return values_[static_cast<std::size_t>(counter)];
+    }
+
+  private:
+    std::array<std::uint64_t, kCounterNumber> values_{};
+  };
+
+  // Values accumulated since the start of the process or the last reset.
+  Statistics GetStatistics();
+
+  void ResetStatistics();
+
+#ifdef AUTOMATA_DISABLE_STATISTICS
+  inline void CountEvent(Counter, std::uint64_t = 1) {}
+#else
+  inline std::array<std::atomic<std::uint64_t>, kCounterNumber> global_counters{};
+
+  inline void CountEvent(Counter counter, std::uint64_t number = 1) {
+    global_counters[static_cast<std::size_t>(counter)].fetch_add(number, std::memory_order_relaxed);
+  }
+#endif
+}
+
+#endif //AUTOMATA_STATISTICS_H
@@ -0,0 +1,40 @@
+#ifndef AUTOMATA_STREAM_MATCHER_H
+#define AUTOMATA_STREAM_MATCHER_H
+
+#include "compiled_dfa.h"
+#include <memory>
+#include <string_view>
+
+namespace automata {
+  // Matches input that arrives in chunks, keeping only the current state of a compiled DFA between them.
+  // Once the state is dead, no continuation of the input can be accepted, and further chunks are skipped.
+  class StreamMatcher {
+  public:
+    explicit StreamMatcher(std::shared_ptr<const CompiledDfa> dfa);
+
+    // Returns false if the input can no longer be accepted, so that the caller can stop reading.
+    bool Feed(std::string_view chunk);
+
+    bool IsAccepting() const {
+      return dfa_->IsAccepting(state_);
+    }
+
+    bool IsDead() const {
+      return state_ == CompiledDfa::kDeadState;
+    }
+
+    void Reset();
+
+    // Bytes consumed since the last reset, not counting the ones skipped after the state became dead.
+    std::size_t GetConsumedByteNumber() const {
+      return consumed_byte_number_;
+    }
+
+  private:
+    std::shared_ptr<const CompiledDfa> dfa_;
+    CompiledDfa::State state_;
+    std::size_t consumed_byte_number_ = 0;
+  };
+}
+
+#endif //AUTOMATA_STREAM_MATCHER_H
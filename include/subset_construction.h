@@ -0,0 +1,125 @@
+#ifndef AUTOMATA_SUBSET_CONSTRUCTION_H
+#define AUTOMATA_SUBSET_CONSTRUCTION_H
+
+#include "automaton.h"
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace automata {
+  // Interns sets of NFA states packed into 64-bit words. The words of all sets are stored back to back in a
+  // single arena, and sets are found by their 64-bit hash in an open-addressing table of set indices.
+  class SubsetTable {
+  public:
+    using Word = std::uint64_t;
+
+    static constexpr std::size_t kWordBits = 64;
+
+    explicit SubsetTable(std::size_t state_number);
+
+    static std::size_t GetWordNumberFor(std::size_t state_number) {
+      return std::max<std::size_t>((state_number + kWordBits - 1) / kWordBits, 1);
+    }
+
+    static void AddState(Word *subset, std::size_t state) {
+      subset[state / kWordBits] |= Word{1} << (state % kWordBits);
+    }
+
+    static bool IsSubset(const Word *first, const Word *second, std::size_t word_number) {
+      for (std::size_t word = 0; word < word_number; ++word) {
+        if (first[word] & ~second[word]) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    static bool Intersects(const Word *first, const Word *second, std::size_t word_number) {
+      for (std::size_t word = 0; word < word_number; ++word) {
+        if (first[word] & second[word]) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Calls function(state) for the states of the subset in increasing order.
+    template<typename F>
+    static void ForEachState(const Word *subset, std::size_t word_number, F &&function) {
+      for (std::size_t word = 0; word < word_number; ++word) {
+        for (auto bits = subset[word]; bits; bits &= bits - 1) {
+          function(word * kWordBits + std::countr_zero(bits));
+        }
+      }
+    }
+
+    static std::uint64_t GetHash(const Word *subset, std::size_t word_number);
+
+    // Returns the index of the set and whether it was added.
+    std::pair<std::size_t, bool> Insert(const Word *subset, std::uint64_t hash);
+
+    const Word *GetSubset(std::size_t index) const {
+      return &words_[index * word_number_];
+    }
+
+    std::size_t GetSubsetNumber() const {
+      return hashes_.size();
+    }
+
+    std::size_t GetWordNumber() const {
+      return word_number_;
+    }
+
+  private:
+    void Grow();
+
+    std::size_t word_number_;
+    std::vector<Word> words_;
+    std::vector<std::uint64_t> hashes_;
+    // Index + 1 of the set in every slot, 0 for empty slots. The size is a power of 2.
+    std::vector<std::size_t> slots_;
+  };
+
+  // Determinizes an NFA with single-letter transitions. Subsets are expanded by iterating over their members
+  // only, and the per-symbol successor sets are kept in buffers reused by all subsets. States of the result
+  // are numbered in the same order as the straightforward construction: subsets are expanded last in, first
+  // out, and the successors of a subset are visited in reverse order of the first occurrence of the symbol.
+  //
+  // With several threads, every worker expands subsets from its own mutex-guarded deque and steals from the
+  // others when it runs dry, sleeping while all deques are empty. Subsets are interned in a table sharded by
+  // hash, and each worker records the transitions it finds in its own buffer. The buffers are merged by
+  // replaying the sequential order of discovery, so the result is the same for any number of threads.
+  class SubsetConstruction {
+  public:
+    explicit SubsetConstruction(const NondeterministicAutomaton &automaton);
+
+    DeterministicAutomaton Determinize(std::size_t thread_number = 1) const;
+
+    // Also returns the accepting states of the NFA, in increasing order, in the subset of every state.
+    DeterministicAutomaton Determinize(std::size_t thread_number,
+                                       std::vector<std::vector<std::size_t>> &accepting_states) const;
+
+  private:
+    struct SuccessorBuffers;
+
+    // Appends the accepting states of the subset to accepting_states and calls function(symbol, successor) for
+    // every symbol leaving the subset, in the order described above. The successor words are cleared after
+    // the call.
+    template<typename F>
+    void Expand(const SubsetTable::Word *subset, SuccessorBuffers &buffers, std::vector<std::size_t> &accepting_states,
+                F &&function) const;
+
+    DeterministicAutomaton DeterminizeInParallel(std::size_t thread_number,
+                                                 std::vector<std::vector<std::size_t>> &accepting_states) const;
+
+    std::size_t state_number_;
+    std::size_t initial_state_;
+    std::vector<bool> is_accepting_;
+    // Transitions of state s are symbols_[i] -> to_states_[i] for i in [offsets_[s], offsets_[s + 1]).
+    std::vector<std::size_t> offsets_;
+    std::vector<unsigned char> symbols_;
+    std::vector<std::size_t> to_states_;
+  };
+}
+
+#endif //AUTOMATA_SUBSET_CONSTRUCTION_H
@@ -0,0 +1,34 @@
+#ifndef AUTOMATA_TEXT_FORMAT_H
+#define AUTOMATA_TEXT_FORMAT_H
+
+#include "automaton.h"
+#include <string>
+#include <string_view>
+
+namespace automata {
+  // Bulk loader for the text format read by Parse:
+  //   [number of states] [initial state]
+  //   [accepting state]...
+  //   [from state] [to state] [transition string]
+  //   ...
+  // followed by an empty line; anything after that is ignored. Accepts exactly the inputs Parse accepts. A
+  // first pass checks the transitions and counts them for every state, so that their storage is allocated
+  // once, and the second one fills them in. Errors are reported as InvalidInputException with the line and
+  // column.
+  template<typename T>
+  T ParseText(std::string_view text);
+
+  // Reads the whole file in one block and parses it.
+  template<typename T>
+  T LoadText(const std::string &path);
+
+  extern template DeterministicAutomaton ParseText<DeterministicAutomaton>(std::string_view text);
+
+  extern template NondeterministicAutomaton ParseText<NondeterministicAutomaton>(std::string_view text);
+
+  extern template DeterministicAutomaton LoadText<DeterministicAutomaton>(const std::string &path);
+
+  extern template NondeterministicAutomaton LoadText<NondeterministicAutomaton>(const std::string &path);
+}
+
+#endif //AUTOMATA_TEXT_FORMAT_H
@@ -0,0 +1,49 @@
+#ifndef AUTOMATA_TRACE_H
+#define AUTOMATA_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace automata {
+  // Timing spans of the pipeline stages, for finding where the time of nested operations goes. While tracing
+  // is enabled, every TraceSpan records its name, start and duration into a ring buffer of the thread that
+  // created it; the buffer is written by that thread only, so recording takes no locks. When a buffer is
+  // full, the oldest spans are overwritten. Building with AUTOMATA_DISABLE_TRACING defined removes the spans
+  // altogether.
+  void SetTracingEnabled(bool enabled);
+
+  bool IsTracingEnabled();
+
+  // Writes the recorded spans in the Chrome trace event format, which chrome://tracing and Perfetto open.
+  // Other threads may keep recording meanwhile; spans they are writing at that moment are left out.
+  void WriteChromeTrace(std::ostream &os);
+
+  // Drops the spans recorded so far. Spans that end after the call are kept.
+  void ClearTrace();
+
+#ifdef AUTOMATA_DISABLE_TRACING
+  class TraceSpan {
+  public:
+    explicit TraceSpan(const char *) {}
+  };
+#else
+  class TraceSpan {
+  public:
+    // The name must outlive the trace, as string literals do.
+    explicit TraceSpan(const char *name);
+
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan &) = delete;
+
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+  private:
+    const char *name_;
+    std::chrono::steady_clock::time_point begin_;
+  };
+#endif
+}
+
+#endif //AUTOMATA_TRACE_H
@@ -1,9 +1,21 @@
 #include "automaton.h"
 #include "regex.h"
+#include "nfa_simulator.h"
+#include "parallel.h"
+#include "product.h"
+#include "statistics.h"
+#include "subset_construction.h"
+#include "trace.h"
 #include <vector>
 #include <algorithm>
 #include <set>
-#include <cassert>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
 
 namespace automata {
   void SkipNewline(std::istream &is) {
@@ -32,7 +44,50 @@ namespace automata {
     return IsAccepting(current_state);
   }
 
+  namespace {
+    class SymbolCollector : public regex::Visitor {
+    public:
+      explicit SymbolCollector(std::set<char> &symbols) : symbols_(symbols) {}
+
+      void Exit(const regex::Literal &regex) override {
+        symbols_.insert(regex.symbol);
+      }
+
+    private:
+      std::set<char> &symbols_;
+    };
+  }
+
+  DeterministicAutomaton DeterministicAutomaton::FromRegexDerivatives(const regex::Regex &input,
+                                                                     const std::vector<char> &alphabet) {
+    TraceSpan span("FromRegexDerivatives");
+    auto alphabet_set = std::set(alphabet.begin(), alphabet.end());
+    SymbolCollector collector(alphabet_set);
+    input.Visit(collector);
+
+    // Derivatives are compared by node identity, so the input is imported into the store of the builder.
+    auto store = std::make_shared<regex::NodeStore>();
+    regex::DerivativeBuilder builder(store);
+    std::vector<regex::Regex> states{input.ImportTo(store)};
+    std::unordered_map<const regex::RegexNode *, std::size_t> state_indices{{&states[0].root(), 0}};
+    DeterministicAutomaton automaton{1, 0};
+    for (std::size_t state = 0; state < states.size(); ++state) {
+      automaton.SetAccepting(state, builder.IsNullable(states[state]));
+      for (char symbol: alphabet_set) {
+        auto derivative = builder.GetDerivative(states[state], symbol);
+        auto [it, inserted] = state_indices.emplace(&derivative.root(), states.size());
+        if (inserted) {
+          states.push_back(derivative);
+          automaton.AddState();
+        }
+        automaton.AddTransition(state, it->second, symbol);
+      }
+    }
+    return automaton;
+  }
+
   DeterministicAutomaton &DeterministicAutomaton::MakeComplete(const std::vector<char> &alphabet) {
+    TraceSpan span("MakeComplete");
     auto alphabet_set = std::set(alphabet.begin(), alphabet.end());
     ForEachTransition([&alphabet_set](auto from_state, auto to_state, auto transition_symbol) {
       alphabet_set.insert(transition_symbol);
@@ -62,39 +117,258 @@ namespace automata {
     return *this;
   }
 
-  DeterministicAutomaton DeterministicAutomaton::Minimize() const {
+  DeterministicAutomaton DeterministicAutomaton::Minimize(MinimizationAlgorithm algorithm,
+                                                         std::size_t thread_number) const {
+    TraceSpan span("Minimize");
+    if (algorithm == MinimizationAlgorithm::kMoore) {
+      std::vector<std::size_t> class_indexes(GetStateNumber());
+      for (std::size_t state = 0; state < GetStateNumber(); ++state) {
+        if (IsAccepting(state) != IsAccepting(0)) {
+          class_indexes[state] = 1;
+        }
+      }
+      return BuildQuotient(GetMooreClasses(std::move(class_indexes), thread_number));
+    }
+    if (thread_number != 1) {
+      throw std::invalid_argument("Hopcroft's algorithm runs on one thread");
+    }
+    return BuildQuotient(GetHopcroftClasses());
+  }
+
+  DeterministicAutomaton DeterministicAutomaton::MinimizeLabeled(std::vector<std::size_t> &labels,
+                                                                std::size_t thread_number) const {
+    TraceSpan span("MinimizeLabeled");
+    if (labels.size() != GetStateNumber()) {
+      throw BadAutomatonException("Sizes of labels and states differ");
+    }
+    // Classes are numbered in order of their first state, both initially and in every round of Moore's
+    // algorithm, so the class of a state is also its state in the quotient.
     std::vector<std::size_t> class_indexes(GetStateNumber());
-    std::size_t class_number;
-    auto reachable_states = GetReachableStates();
+    std::map<std::pair<std::size_t, bool>, std::size_t> index_of_class;
+    for (std::size_t state = 0; state < GetStateNumber(); ++state) {
+      class_indexes[state] = index_of_class.emplace(std::pair(labels[state], IsAccepting(state)),
+                                                    index_of_class.size()).first->second;
+    }
+    class_indexes = GetMooreClasses(std::move(class_indexes), thread_number);
+    auto minimized = BuildQuotient(class_indexes);
+    std::vector<std::size_t> minimized_labels(minimized.GetStateNumber());
     for (std::size_t state = 0; state < GetStateNumber(); ++state) {
-      if (IsAccepting(state) != IsAccepting(0)) {
-        class_indexes[state] = 1;
+      minimized_labels[class_indexes[state]] = labels[state];
+    }
+    labels = std::move(minimized_labels);
+    return minimized;
+  }
+
+  namespace {
+    // Fewer states than this per thread are not worth a thread in a round of Moore's algorithm.
+    constexpr std::size_t kMinMooreChunkSize = 1 << 12;
+  }
+
+  std::vector<std::size_t> DeterministicAutomaton::GetMooreClasses(std::vector<std::size_t> class_indexes,
+                                                                   std::size_t thread_number) const {
+    auto state_number = GetStateNumber();
+    auto symbol_number = GetTransitions(0).size();
+    std::vector<std::size_t> to_states;
+    to_states.reserve(state_number * symbol_number);
+    for (std::size_t state = 0; state < state_number; ++state) {
+      if (GetTransitions(state).size() != symbol_number) {
+        throw BadAutomatonException("The given DFA is not complete");
+      }
+      for (auto transition: GetTransitions(state)) {
+        to_states.push_back(transition.to_state);
       }
     }
+
+    // The signature of a state is its class followed by the classes of its successors.
+    auto width = symbol_number + 1;
+    std::vector<std::size_t> signatures(state_number * width);
+    std::vector<std::size_t> hashes(state_number);
+    auto get_hash = [&hashes](std::size_t state) {
+      return hashes[state];
+    };
+    auto are_equal = [&signatures, width](std::size_t first, std::size_t second) {
+      return std::equal(&signatures[first * width], &signatures[(first + 1) * width], &signatures[second * width]);
+    };
     while (true) {
-      std::vector<std::size_t> new_class_indexes(GetStateNumber());
-      std::map<std::vector<std::size_t>, std::size_t> index_of_class;
-      for (std::size_t state = 0; state < GetStateNumber(); ++state) {
-        if (GetTransitions(state).size() != GetTransitions(0).size()) {
+      ParallelFor(state_number, thread_number, [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (auto state = begin; state < end; ++state) {
+          auto signature = &signatures[state * width];
+          signature[0] = class_indexes[state];
+          for (std::size_t i = 0; i < symbol_number; ++i) {
+            signature[i + 1] = class_indexes[to_states[state * symbol_number + i]];
+          }
+          std::size_t hash = 0;
+          for (std::size_t i = 0; i < width; ++i) {
+            hash ^= signature[i] + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+          }
+          hashes[state] = hash;
+        }
+      }, kMinMooreChunkSize);
+
+      // Classes are numbered in order of their first state, so the numbering does not depend on the threads.
+      std::vector<std::size_t> new_class_indexes(state_number);
+      std::unordered_map<std::size_t, std::size_t, decltype(get_hash), decltype(are_equal)>
+          index_of_class(state_number, get_hash, are_equal);
+      for (std::size_t state = 0; state < state_number; ++state) {
+        new_class_indexes[state] = index_of_class.emplace(state, index_of_class.size()).first->second;
+      }
+      CountEvent(Counter::kMinimizationRounds);
+      if (new_class_indexes == class_indexes) {
+        CountEvent(Counter::kMinimizationBlocks, index_of_class.size());
+        break;
+      }
+      class_indexes = std::move(new_class_indexes);
+    }
+    return class_indexes;
+  }
+
+  std::vector<std::size_t> DeterministicAutomaton::GetHopcroftClasses() const {
+    auto state_number = GetStateNumber();
+    std::vector<char> alphabet;
+    for (auto transition: GetTransitions(0)) {
+      alphabet.push_back(transition.symbol);
+    }
+    auto symbol_number = alphabet.size();
+
+    // Predecessors of every (state, symbol) pair, stored contiguously.
+    std::vector<std::size_t> predecessor_offsets(state_number * symbol_number + 1);
+    for (std::size_t state = 0; state < state_number; ++state) {
+      const auto &transitions = GetTransitions(state);
+      if (transitions.size() != symbol_number) {
+        throw BadAutomatonException("The given DFA is not complete");
+      }
+      std::size_t symbol_index = 0;
+      for (auto transition: transitions) {
+        if (transition.symbol != alphabet[symbol_index]) {
           throw BadAutomatonException("The given DFA is not complete");
         }
-        std::vector<std::size_t> new_class{class_indexes[state]};
+        ++predecessor_offsets[transition.to_state * symbol_number + symbol_index + 1];
+        ++symbol_index;
+      }
+    }
+    for (std::size_t i = 1; i < predecessor_offsets.size(); ++i) {
+      predecessor_offsets[i] += predecessor_offsets[i - 1];
+    }
+    std::vector<std::size_t> predecessors(predecessor_offsets.back());
+    {
+      auto insert_position = predecessor_offsets;
+      for (std::size_t state = 0; state < state_number; ++state) {
+        std::size_t symbol_index = 0;
         for (auto transition: GetTransitions(state)) {
-          new_class.push_back(class_indexes[transition.to_state]);
+          predecessors[insert_position[transition.to_state * symbol_number + symbol_index]++] = state;
+          ++symbol_index;
         }
-        auto it = index_of_class.find(new_class);
-        if (it != index_of_class.end()) {
-          new_class_indexes[state] = it->second;
-        } else {
-          new_class_indexes[state] = index_of_class.size();
-          index_of_class[new_class] = new_class_indexes[state];
+      }
+    }
+
+    // Blocks are contiguous ranges of `elements`; marked states are moved to the front of their block.
+    std::vector<std::size_t> elements(state_number);
+    std::vector<std::size_t> location(state_number);
+    std::vector<std::size_t> block_of(state_number);
+    std::vector<std::size_t> block_begin, block_end, marked_number;
+    std::vector<bool> is_splitter;
+    std::size_t accepting_number = std::ranges::count(is_accepting(), true);
+    std::size_t next_accepting = 0, next_rejecting = accepting_number;
+    for (std::size_t state = 0; state < state_number; ++state) {
+      auto position = IsAccepting(state) ? next_accepting++ : next_rejecting++;
+      elements[position] = state;
+      location[state] = position;
+    }
+    auto add_block = [&](std::size_t begin, std::size_t end) {
+      for (auto position = begin; position < end; ++position) {
+        block_of[elements[position]] = block_begin.size();
+      }
+      block_begin.push_back(begin);
+      block_end.push_back(end);
+      marked_number.push_back(0);
+      is_splitter.resize(block_begin.size() * symbol_number);
+      return block_begin.size() - 1;
+    };
+    auto block_size = [&](std::size_t block) {
+      return block_end[block] - block_begin[block];
+    };
+
+    std::vector<std::pair<std::size_t, std::size_t>> splitters;
+    auto push_splitter = [&](std::size_t block, std::size_t symbol_index) {
+      is_splitter[block * symbol_number + symbol_index] = true;
+      splitters.emplace_back(block, symbol_index);
+    };
+
+    if (accepting_number == 0 || accepting_number == state_number) {
+      add_block(0, state_number);
+    } else {
+      auto accepting_block = add_block(0, accepting_number);
+      auto rejecting_block = add_block(accepting_number, state_number);
+      auto smaller_block = block_size(accepting_block) <= block_size(rejecting_block) ? accepting_block
+                                                                                       : rejecting_block;
+      for (std::size_t symbol_index = 0; symbol_index < symbol_number; ++symbol_index) {
+        push_splitter(smaller_block, symbol_index);
+      }
+    }
+
+    std::vector<std::size_t> splitter_states;
+    std::vector<std::size_t> touched_blocks;
+    std::size_t round_number = 0;
+    while (!splitters.empty()) {
+      ++round_number;
+      auto [splitter, symbol_index] = splitters.back();
+      splitters.pop_back();
+      is_splitter[splitter * symbol_number + symbol_index] = false;
+
+      splitter_states.assign(elements.begin() + block_begin[splitter], elements.begin() + block_end[splitter]);
+      for (auto to_state: splitter_states) {
+        auto key = to_state * symbol_number + symbol_index;
+        for (auto i = predecessor_offsets[key]; i < predecessor_offsets[key + 1]; ++i) {
+          auto state = predecessors[i];
+          auto block = block_of[state];
+          auto marked_end = block_begin[block] + marked_number[block];
+          if (location[state] < marked_end) {
+            continue;
+          }
+          if (marked_number[block] == 0) {
+            touched_blocks.push_back(block);
+          }
+          auto other_state = elements[marked_end];
+          std::swap(elements[location[state]], elements[marked_end]);
+          location[other_state] = location[state];
+          location[state] = marked_end;
+          ++marked_number[block];
         }
       }
-      class_number = index_of_class.size();
-      if (new_class_indexes == class_indexes) {
-        break;
+
+      for (auto block: touched_blocks) {
+        auto marked = marked_number[block];
+        marked_number[block] = 0;
+        if (marked == block_size(block)) {
+          continue;
+        }
+        auto marked_begin = block_begin[block];
+        block_begin[block] = marked_begin + marked;
+        auto new_block = add_block(marked_begin, marked_begin + marked);
+        for (std::size_t other_symbol = 0; other_symbol < symbol_number; ++other_symbol) {
+          if (is_splitter[block * symbol_number + other_symbol]) {
+            push_splitter(new_block, other_symbol);
+          } else {
+            push_splitter(block_size(new_block) <= block_size(block) ? new_block : block, other_symbol);
+          }
+        }
+      }
+      touched_blocks.clear();
+    }
+    CountEvent(Counter::kMinimizationRounds, round_number);
+    CountEvent(Counter::kMinimizationBlocks, block_begin.size());
+    return block_of;
+  }
+
+  DeterministicAutomaton DeterministicAutomaton::BuildQuotient(std::vector<std::size_t> class_indexes) const {
+    // Classes are renumbered in order of their first state so that the result does not depend on the algorithm.
+    std::vector<std::optional<std::size_t>> renumbered(GetStateNumber());
+    std::size_t class_number = 0;
+    for (auto &class_index: class_indexes) {
+      if (!renumbered[class_index]) {
+        renumbered[class_index] = class_number++;
       }
-      class_indexes = new_class_indexes;
+      class_index = *renumbered[class_index];
     }
     DeterministicAutomaton minimized_automaton{class_number, class_indexes[initial_state()]};
     for (std::size_t state = 0; state < GetStateNumber(); ++state) {
@@ -106,28 +380,9 @@ namespace automata {
     return minimized_automaton;
   }
 
-  DeterministicAutomaton DeterministicAutomaton::Intersection(const DeterministicAutomaton &other) const {
-    auto get_index = [step = other.GetStateNumber()](std::size_t this_state, std::size_t other_state) {
-      return this_state * step + other_state;
-    };
-    DeterministicAutomaton result{GetStateNumber() * other.GetStateNumber(),
-                                  get_index(initial_state(), other.initial_state())};
-    for (std::size_t this_from_state = 0; this_from_state < GetStateNumber(); ++this_from_state) {
-      for (std::size_t other_from_state = 0; other_from_state < other.GetStateNumber(); ++other_from_state) {
-        auto new_state = get_index(this_from_state, other_from_state);
-        if (IsAccepting(this_from_state) && other.IsAccepting(other_from_state)) {
-          result.SetAccepting(new_state);
-        }
-        const auto &other_transitions = other.GetTransitions(other_from_state);
-        for (auto transition: GetTransitions(this_from_state)) {
-          auto it = other_transitions.find(transition.symbol);
-          if (it != other_transitions.end()) {
-            result.AddTransition(new_state, get_index(transition.to_state, it->second), transition.symbol);
-          }
-        }
-      }
-    }
-    return result;
+  DeterministicAutomaton DeterministicAutomaton::Intersection(const DeterministicAutomaton &other,
+                                                             std::size_t thread_number) const {
+    return ProductBuilder({this, &other}, thread_number).Build();
   }
 
   bool DeterministicAutomaton::IsComplete() const {
@@ -176,14 +431,162 @@ namespace automata {
     return is_isomorphic;
   }
 
+  namespace {
+    // Lets two DFAs be walked in lockstep: state GetStateNumber() of each automaton is an implicit sink.
+    class PairWalker {
+    public:
+      PairWalker(const DeterministicAutomaton &first, const DeterministicAutomaton &second) :
+          first_(first), second_(second) {}
+
+      std::size_t GetFirstSink() const {
+        return first_.GetStateNumber();
+      }
+
+      std::size_t GetSecondSink() const {
+        return second_.GetStateNumber();
+      }
+
+      bool AcceptanceDiffers(std::size_t first_state, std::size_t second_state) const {
+        return IsAccepting(first_, first_state) != IsAccepting(second_, second_state);
+      }
+
+      // Calls function(symbol, first_to_state, second_to_state) in order of symbols for every symbol that
+      // leaves at least one of the states.
+      template<typename F>
+      void ForEachSuccessor(std::size_t first_state, std::size_t second_state, F &&function) const {
+        static const TransitionMap kNoTransitions;
+        const auto &first_transitions = GetTransitions(first_, first_state, kNoTransitions);
+        const auto &second_transitions = GetTransitions(second_, second_state, kNoTransitions);
+        auto first_it = first_transitions.begin();
+        auto second_it = second_transitions.begin();
+        while (first_it != first_transitions.end() || second_it != second_transitions.end()) {
+          if (second_it == second_transitions.end() ||
+              (first_it != first_transitions.end() && (*first_it).symbol < (*second_it).symbol)) {
+            function((*first_it).symbol, (*first_it).to_state, GetSecondSink());
+            ++first_it;
+          } else if (first_it == first_transitions.end() || (*second_it).symbol < (*first_it).symbol) {
+            function((*second_it).symbol, GetFirstSink(), (*second_it).to_state);
+            ++second_it;
+          } else {
+            function((*first_it).symbol, (*first_it).to_state, (*second_it).to_state);
+            ++first_it;
+            ++second_it;
+          }
+        }
+      }
+
+    private:
+      static bool IsAccepting(const DeterministicAutomaton &automaton, std::size_t state) {
+        return state < automaton.GetStateNumber() && automaton.IsAccepting(state);
+      }
+
+      static const TransitionMap &GetTransitions(const DeterministicAutomaton &automaton, std::size_t state,
+                                                 const TransitionMap &no_transitions) {
+        return state < automaton.GetStateNumber() ? automaton.GetTransitions(state) : no_transitions;
+      }
+
+      const DeterministicAutomaton &first_;
+      const DeterministicAutomaton &second_;
+    };
+
+    // Pairs of states of a PairWalker, sinks included. Small products are marked in a bitmap indexed by
+    // first * (second sink + 1) + second; larger ones, whose bitmap would take too much memory, in a hash set.
+    class VisitedPairs {
+    public:
+      static constexpr std::size_t kMaxBitmapSize = std::size_t{1} << 27;
+
+      explicit VisitedPairs(const PairWalker &walker) : second_state_number_(walker.GetSecondSink() + 1) {
+        auto pair_number = (walker.GetFirstSink() + 1) * second_state_number_;
+        if (pair_number <= kMaxBitmapSize) {
+          bitmap_.resize(pair_number);
+        }
+      }
+
+      // Returns whether the pair was not marked yet.
+      bool Mark(std::size_t first_state, std::size_t second_state) {
+        auto index = first_state * second_state_number_ + second_state;
+        if (bitmap_.empty()) {
+          return hashed_.insert(index).second;
+        }
+        if (bitmap_[index]) {
+          return false;
+        }
+        bitmap_[index] = true;
+        return true;
+      }
+
+    private:
+      std::size_t second_state_number_;
+      std::vector<bool> bitmap_;
+      std::unordered_set<std::size_t> hashed_;
+    };
+
+    bool AreBisimilar(const PairWalker &walker, std::size_t first_initial_state, std::size_t second_initial_state) {
+      // States of the second automaton follow the states of the first one, including the sinks.
+      auto offset = walker.GetFirstSink() + 1;
+      std::vector<std::size_t> parent(offset + walker.GetSecondSink() + 1);
+      std::iota(parent.begin(), parent.end(), 0);
+      auto find = [&parent](std::size_t element) {
+        while (parent[element] != element) {
+          element = parent[element] = parent[parent[element]];
+        }
+        return element;
+      };
+      parent[first_initial_state] = offset + second_initial_state;
+      std::vector<std::pair<std::size_t, std::size_t>> to_process{{first_initial_state, second_initial_state}};
+      while (!to_process.empty()) {
+        auto [first_state, second_state] = to_process.back();
+        to_process.pop_back();
+        if (walker.AcceptanceDiffers(first_state, second_state)) {
+          return false;
+        }
+        walker.ForEachSuccessor(first_state, second_state, [&](char, auto first_to_state, auto second_to_state) {
+          auto first_root = find(first_to_state);
+          auto second_root = find(offset + second_to_state);
+          if (first_root != second_root) {
+            parent[first_root] = second_root;
+            to_process.emplace_back(first_to_state, second_to_state);
+          }
+        });
+      }
+      return true;
+    }
+  }
+
+  std::optional<std::string> DeterministicAutomaton::FindDistinguishingWord(const DeterministicAutomaton &other) const {
+    PairWalker walker(*this, other);
+    if (AreBisimilar(walker, initial_state(), other.initial_state())) {
+      return std::nullopt;
+    }
+    struct Node {
+      std::size_t state, other_state;
+      std::optional<std::size_t> parent;
+      char symbol;
+    };
+    std::vector<Node> nodes{{initial_state(), other.initial_state(), std::nullopt, '\0'}};
+    VisitedPairs visited(walker);
+    visited.Mark(initial_state(), other.initial_state());
+    for (std::size_t node = 0; node < nodes.size(); ++node) {
+      if (walker.AcceptanceDiffers(nodes[node].state, nodes[node].other_state)) {
+        std::string word;
+        for (auto current = node; nodes[current].parent; current = *nodes[current].parent) {
+          word.push_back(nodes[current].symbol);
+        }
+        std::ranges::reverse(word);
+        return word;
+      }
+      walker.ForEachSuccessor(nodes[node].state, nodes[node].other_state,
+                              [&nodes, &visited, node](char symbol, auto to_state, auto other_to_state) {
+        if (visited.Mark(to_state, other_to_state)) {
+          nodes.push_back({to_state, other_to_state, node, symbol});
+        }
+      });
+    }
+    throw BadAutomatonException("Distinguishing word not found");
+  }
+
   bool DeterministicAutomaton::IsEquivalent(const DeterministicAutomaton &other) const {
-    auto minimized = ToComplete({}).Minimize();
-    auto other_minimized = other.ToComplete({}).Minimize();
-    // TODO: Maybe isomorphism check is redundant
-    auto is_equivalent_without_isomorphism_check = minimized == other_minimized;
-    auto is_equivalent = minimized.IsIsomorphic(other_minimized);
-    assert(is_equivalent_without_isomorphism_check == is_equivalent);
-    return is_equivalent;
+    return !FindDistinguishingWord(other);
   }
 
   NondeterministicAutomaton::NondeterministicAutomaton(const DeterministicAutomaton &deterministic) :
@@ -193,7 +596,41 @@ namespace automata {
     });
   }
 
+  NondeterministicAutomaton::SimulatorCache::SimulatorCache(const SimulatorCache &other) {
+    *this = other;
+  }
+
+  NondeterministicAutomaton::SimulatorCache &
+  NondeterministicAutomaton::SimulatorCache::operator=(const SimulatorCache &other) {
+    if (this != &other) {
+      std::lock_guard lock(other.mutex_);
+      simulator_ = other.simulator_;
+      simulator_pointer_.store(simulator_.get(), std::memory_order_release);
+    }
+    return *this;
+  }
+
+  const NfaSimulator &NondeterministicAutomaton::SimulatorCache::Get(const NondeterministicAutomaton &automaton) const {
+    if (const auto *simulator = simulator_pointer_.load(std::memory_order_acquire)) {
+      return *simulator;
+    }
+    // Built without the lock, since building copies the automaton and with it this cache. Threads racing for
+    // the first call may build several simulators, of which the first one is kept.
+    auto simulator = std::make_shared<const NfaSimulator>(automaton);
+    std::lock_guard lock(mutex_);
+    if (!simulator_) {
+      simulator_ = std::move(simulator);
+      simulator_pointer_.store(simulator_.get(), std::memory_order_release);
+    }
+    return *simulator_;
+  }
+
+  bool NondeterministicAutomaton::AcceptsString(std::string_view string) const {
+    return simulator_cache_.Get(*this).AcceptsString(string);
+  }
+
   NondeterministicAutomaton &NondeterministicAutomaton::SplitTransitions() {
+    TraceSpan span("SplitTransitions");
     auto state_number = GetStateNumber();
     for (std::size_t state = 0; state < state_number; ++state) {
       auto old_transitions = std::move(transitions_[state]);
@@ -212,97 +649,171 @@ namespace automata {
         }
       }
     }
+    OnModified();
     return *this;
   }
 
-  NondeterministicAutomaton NondeterministicAutomaton::RemoveEmptyTransitions() const {
-    auto state_number = GetStateNumber();
-    NondeterministicAutomaton result{state_number, initial_state()};
-    for (std::size_t from_state = 0; from_state < state_number; ++from_state) {
-      std::vector<bool> visited(state_number);
-      visited[from_state] = true;
-      std::vector<std::size_t> to_process{from_state};
-      while (!to_process.empty()) {
-        auto current_state = to_process.back();
-        to_process.pop_back();
-        for (const auto &transition: GetTransitions(current_state)) {
-          if (transition.symbol.empty() && !visited[transition.to_state]) {
-            visited[transition.to_state] = true;
-            to_process.push_back(transition.to_state);
-          }
+  namespace {
+    constexpr std::size_t kUnvisited = std::numeric_limits<std::size_t>::max();
+
+    // Finds strongly connected components of a graph, given as adjacency lists stored contiguously, by Tarjan's
+    // algorithm without recursion. Components are numbered in reverse topological order: edges never lead to
+    // a component with a greater number.
+    std::vector<std::size_t> GetStronglyConnectedComponents(const std::vector<std::size_t> &offsets,
+                                                            const std::vector<std::size_t> &targets,
+                                                            std::size_t &component_number) {
+      auto vertex_number = offsets.size() - 1;
+      std::vector<std::size_t> indices(vertex_number, kUnvisited);
+      std::vector<std::size_t> low_links(vertex_number);
+      std::vector<std::size_t> components(vertex_number, kUnvisited);
+      std::vector<std::size_t> stack;
+      // Vertices of the depth-first search path and the next edge to follow from each of them.
+      std::vector<std::pair<std::size_t, std::size_t>> path;
+      std::size_t index = 0;
+      component_number = 0;
+      auto enter = [&](std::size_t vertex) {
+        indices[vertex] = low_links[vertex] = index++;
+        stack.push_back(vertex);
+        path.emplace_back(vertex, offsets[vertex]);
+      };
+      for (std::size_t root = 0; root < vertex_number; ++root) {
+        if (indices[root] != kUnvisited) {
+          continue;
         }
-      }
-      for (std::size_t to_state = 0; to_state < state_number; ++to_state) {
-        if (visited[to_state]) {
-          if (IsAccepting(to_state)) {
-            result.SetAccepting(from_state);
-          }
-          for (const auto &transition: GetTransitions(to_state)) {
-            if (!transition.symbol.empty()) {
-              result.AddTransition(from_state, transition.to_state, transition.symbol);
+        enter(root);
+        while (!path.empty()) {
+          auto [vertex, edge] = path.back();
+          if (edge < offsets[vertex + 1]) {
+            ++path.back().second;
+            auto target = targets[edge];
+            if (indices[target] == kUnvisited) {
+              enter(target);
+            } else if (components[target] == kUnvisited) {
+              low_links[vertex] = std::min(low_links[vertex], indices[target]);
             }
+            continue;
+          }
+          path.pop_back();
+          if (!path.empty()) {
+            auto parent = path.back().first;
+            low_links[parent] = std::min(low_links[parent], low_links[vertex]);
+          }
+          if (low_links[vertex] == indices[vertex]) {
+            std::size_t member;
+            do {
+              member = stack.back();
+              stack.pop_back();
+              components[member] = component_number;
+            } while (member != vertex);
+            ++component_number;
           }
         }
       }
-      result.RemoveDuplicateTransitions(from_state);
+      return components;
     }
-    return result;
   }
 
-  DeterministicAutomaton NondeterministicAutomaton::DeterminizeSingleLetterTransitions() const {
-    std::vector<bool> initial_subset(GetStateNumber());
-    initial_subset[initial_state()] = true;
-    std::map<std::vector<bool>, std::size_t> subset_indices{{initial_subset, 0}};
-    std::vector<std::vector<bool>> to_process{initial_subset};
-    DeterministicAutomaton determinized_automaton{1, 0};
-
-    while (!to_process.empty()) {
-      auto current_subset = std::move(to_process.back());
-      to_process.pop_back();
-      auto current_subset_index = subset_indices.at(current_subset);
-      std::unordered_map<char, std::vector<bool>> subset_transitions;
-
-      for (std::size_t state = 0; state < GetStateNumber(); ++state) {
-        if (!current_subset[state]) {
-          continue;
-        }
-        if (IsAccepting(state)) {
-          determinized_automaton.SetAccepting(current_subset_index);
+  NondeterministicAutomaton NondeterministicAutomaton::RemoveEmptyTransitions() const {
+    TraceSpan span("RemoveEmptyTransitions");
+    auto state_number = GetStateNumber();
+    std::vector<std::size_t> offsets{0};
+    std::vector<std::size_t> targets;
+    for (std::size_t state = 0; state < state_number; ++state) {
+      for (const auto &transition: GetTransitions(state)) {
+        if (transition.symbol.empty()) {
+          targets.push_back(transition.to_state);
         }
-        for (auto transition: GetTransitions(state)) {
-          if (transition.symbol.size() != 1) {
-            throw BadAutomatonException("Transition is not single-letter");
+      }
+      offsets.push_back(targets.size());
+    }
+    CountEvent(Counter::kEmptyTransitionsRemoved, targets.size());
+    std::size_t component_number;
+    auto components = GetStronglyConnectedComponents(offsets, targets, component_number);
+    std::vector<std::size_t> member_offsets(component_number + 1);
+    for (auto component: components) {
+      ++member_offsets[component + 1];
+    }
+    std::partial_sum(member_offsets.begin(), member_offsets.end(), member_offsets.begin());
+    std::vector<std::size_t> members(state_number);
+    auto next_member = member_offsets;
+    for (std::size_t state = 0; state < state_number; ++state) {
+      members[next_member[components[state]]++] = state;
+    }
+
+    // All states of a component have the same closure, which is the component itself and the closures of the
+    // components its empty transitions lead to. Those have smaller numbers, so they are already known.
+    std::vector<std::vector<std::size_t>> closures(component_number);
+    std::vector<bool> is_accepting(component_number);
+    std::vector<std::size_t> last_seen(component_number, kUnvisited);
+    NondeterministicAutomaton result{state_number, initial_state()};
+    for (std::size_t component = 0; component < component_number; ++component) {
+      auto &closure = closures[component];
+      closure.push_back(component);
+      last_seen[component] = component;
+      for (auto member = member_offsets[component]; member < member_offsets[component + 1]; ++member) {
+        auto state = members[member];
+        is_accepting[component] = is_accepting[component] || IsAccepting(state);
+        for (auto edge = offsets[state]; edge < offsets[state + 1]; ++edge) {
+          auto to_component = components[targets[edge]];
+          if (last_seen[to_component] == component) {
+            continue;
           }
-          auto symbol = transition.symbol[0];
-          if (!subset_transitions.count(symbol)) {
-            subset_transitions[symbol] = std::vector<bool>(GetStateNumber());
+          is_accepting[component] = is_accepting[component] || is_accepting[to_component];
+          for (auto closure_component: closures[to_component]) {
+            if (last_seen[closure_component] != component) {
+              last_seen[closure_component] = component;
+              closure.push_back(closure_component);
+            }
           }
-          subset_transitions[symbol][transition.to_state] = true;
         }
       }
 
-      for (const auto &[symbol, to_subset]: subset_transitions) {
-        std::size_t to_subset_index;
-        if (subset_indices.count(to_subset)) {
-          to_subset_index = subset_indices.at(to_subset);
-        } else {
-          to_subset_index = determinized_automaton.AddState();
-          subset_indices[to_subset] = to_subset_index;
-          to_process.push_back(to_subset);
+      auto first_state = members[member_offsets[component]];
+      for (auto closure_component: closure) {
+        for (auto member = member_offsets[closure_component]; member < member_offsets[closure_component + 1];
+             ++member) {
+          for (const auto &transition: GetTransitions(members[member])) {
+            if (!transition.symbol.empty()) {
+              result.AddTransition(first_state, transition.to_state, transition.symbol);
+            }
+          }
+        }
+      }
+      result.RemoveDuplicateTransitions(first_state);
+      for (auto member = member_offsets[component]; member < member_offsets[component + 1]; ++member) {
+        result.SetAccepting(members[member], is_accepting[component]);
+        if (members[member] != first_state) {
+          result.transitions_[members[member]] = result.transitions_[first_state];
         }
-        determinized_automaton.AddTransition(current_subset_index, to_subset_index, symbol);
       }
     }
-    return determinized_automaton;
+    result.OnModified();
+    return result;
   }
 
-  DeterministicAutomaton NondeterministicAutomaton::Determinize() const {
+  DeterministicAutomaton
+  NondeterministicAutomaton::DeterminizeSingleLetterTransitions(std::size_t thread_number) const {
+    return SubsetConstruction(*this).Determinize(thread_number);
+  }
+
+  DeterministicAutomaton NondeterministicAutomaton::Determinize(std::size_t thread_number) const {
+    TraceSpan span("Determinize");
     auto result = RemoveEmptyTransitions();
     result.SplitTransitions();
-    return result.DeterminizeSingleLetterTransitions();
+    return result.DeterminizeSingleLetterTransitions(thread_number);
   }
 
-  NondeterministicAutomaton NondeterministicAutomaton::FromRegex(const regex::Regex &input) {
+  NondeterministicAutomaton NondeterministicAutomaton::FromRegex(const regex::Regex &input,
+                                                                 RegexConstruction construction) {
+    TraceSpan span("FromRegex");
+    if (construction == RegexConstruction::kDerivatives) {
+      return NondeterministicAutomaton(DeterministicAutomaton::FromRegexDerivatives(input, {}));
+    }
+    if (construction == RegexConstruction::kGlushkov) {
+      GlushkovVisitor visitor;
+      input.Visit(visitor);
+      return visitor.GetAutomaton();
+    }
     AutomatonVisitor visitor;
     input.Visit(visitor);
     auto automaton = visitor.GetResult();
@@ -310,18 +821,34 @@ namespace automata {
     return automaton;
   }
 
-  regex::Regex NondeterministicAutomaton::ToRegex() const {
+  regex::Regex NondeterministicAutomaton::ToRegex(bool simplify) const {
+    TraceSpan span("ToRegex");
+    // Intermediate regexes live in a store of their own, which is freed once the result is copied out.
+    auto store = std::make_shared<regex::NodeStore>();
+    regex::Simplifier simplifier(store);
+    auto add = [&simplifier, simplify](const regex::Regex &first, const regex::Regex &second) {
+      return simplify ? simplifier.Add(first, second) : first + second;
+    };
+    auto multiply = [&simplifier, simplify](const regex::Regex &first, const regex::Regex &second) {
+      return simplify ? simplifier.Multiply(first, second) : first * second;
+    };
+    auto iterate = [&simplifier, simplify](regex::Regex inner) {
+      return simplify ? simplifier.Iterate(inner) : inner.Iterate();
+    };
+
+    regex::Regex none(store, store->Create<regex::None>());
     auto state_number = GetStateNumber();
-    auto regex_transitions = std::vector(state_number, std::vector<regex::Regex>(state_number,
-                                                                                 regex::Create<regex::None>()));
-    ForEachTransition([&regex_transitions](auto from_state, auto to_state, auto transition_string) {
+    auto regex_transitions = std::vector(state_number, std::vector<regex::Regex>(state_number, none));
+    ForEachTransition([&regex_transitions, &add, &store](auto from_state, auto to_state, auto transition_string) {
       if (transition_string.size() >= 2) {
         throw BadAutomatonException("Length of transition string should be 0 or 1");
       }
+      auto &transition_regex = regex_transitions[from_state][to_state];
       if (transition_string.empty()) {
-        regex_transitions[from_state][to_state] += regex::Create<regex::Empty>();
+        transition_regex = add(transition_regex, regex::Regex(store, store->Create<regex::Empty>()));
       } else {
-        regex_transitions[from_state][to_state] += regex::Create<regex::Literal>(transition_string[0]);
+        transition_regex = add(transition_regex,
+                               regex::Regex(store, store->Create<regex::Literal>(transition_string[0])));
       }
     });
 
@@ -337,34 +864,37 @@ namespace automata {
         accepting_state = state;
         continue;
       }
+      auto loop_regex = iterate(regex_transitions[state][state]);
       for (std::size_t from_state = 0; from_state < state_number; ++from_state) {
+        if (from_state == state || regex_transitions[from_state][state].root().IsNone()) {
+          continue;
+        }
+        auto prefix_regex = multiply(regex_transitions[from_state][state], loop_regex);
         for (std::size_t to_state = 0; to_state < state_number; ++to_state) {
-          if (from_state == state || to_state == state) {
+          if (to_state == state || regex_transitions[state][to_state].root().IsNone()) {
             continue;
           }
-          auto shortcut_regex =
-              regex_transitions[from_state][state] *
-              regex_transitions[state][state].Iterate() *
-              regex_transitions[state][to_state];
-          regex_transitions[from_state][to_state] += shortcut_regex;
+          auto shortcut_regex = multiply(prefix_regex, regex_transitions[state][to_state]);
+          regex_transitions[from_state][to_state] = add(regex_transitions[from_state][to_state], shortcut_regex);
         }
       }
       for (std::size_t other_state = 0; other_state < state_number; ++other_state) {
-        regex_transitions[other_state][state] = regex_transitions[state][other_state] = regex::Create<regex::None>();
+        regex_transitions[other_state][state] = regex_transitions[state][other_state] = none;
       }
     }
-    if (!accepting_state) {
-      return regex::Create<regex::None>();
+    auto result = none;
+    if (accepting_state && initial_state() == *accepting_state) {
+      result = iterate(regex_transitions[initial_state()][initial_state()]);
+    } else if (accepting_state) {
+      auto initial_to_accepting =
+          multiply(iterate(regex_transitions[initial_state()][initial_state()]),
+                   regex_transitions[initial_state()][*accepting_state]);
+      result = multiply(initial_to_accepting,
+                        iterate(add(regex_transitions[*accepting_state][*accepting_state],
+                                    multiply(regex_transitions[*accepting_state][initial_state()],
+                                             initial_to_accepting))));
     }
-    if (initial_state() == *accepting_state) {
-      return regex_transitions[initial_state()][initial_state()].Iterate();
-    }
-    auto initial_to_accepting =
-        regex_transitions[initial_state()][initial_state()].Iterate() *
-        regex_transitions[initial_state()][*accepting_state];
-    return initial_to_accepting * (regex_transitions[*accepting_state][*accepting_state] +
-                                   regex_transitions[*accepting_state][initial_state()] *
-                                   initial_to_accepting).Iterate();
+    return result.ImportTo(std::make_shared<regex::NodeStore>());
   }
 
   NondeterministicAutomaton &NondeterministicAutomaton::MakeSingleAcceptingState() {
@@ -380,6 +910,113 @@ namespace automata {
     return *this;
   }
 
+  namespace {
+    // A set of states packed into words, see SubsetTable.
+    using Subset = std::vector<SubsetTable::Word>;
+
+    NondeterministicAutomaton ToSingleLetterTransitions(const NondeterministicAutomaton &automaton) {
+      auto result = automaton.RemoveEmptyTransitions();
+      result.SplitTransitions();
+      return result;
+    }
+  }
+
+  std::optional<std::string>
+  NondeterministicAutomaton::FindInclusionCounterexample(const NondeterministicAutomaton &other) const {
+    auto automaton = ToSingleLetterTransitions(*this);
+    auto other_automaton = ToSingleLetterTransitions(other);
+    auto word_number = SubsetTable::GetWordNumberFor(other_automaton.GetStateNumber());
+    Subset other_accepting(word_number);
+    for (std::size_t state = 0; state < other_automaton.GetStateNumber(); ++state) {
+      if (other_automaton.IsAccepting(state)) {
+        SubsetTable::AddState(other_accepting.data(), state);
+      }
+    }
+
+    struct Node {
+      std::size_t state;
+      Subset subset;
+      std::optional<std::size_t> parent;
+      char symbol;
+    };
+    std::vector<Node> nodes;
+    // Indices of the nodes with minimal subsets for every state of this automaton. A node removed from here
+    // is still expanded: it may be shallower than the node that replaced it, and the word must be shortest.
+    std::vector<std::vector<std::size_t>> antichains(automaton.GetStateNumber());
+    // Returns true if the added node is a counterexample.
+    auto add_node = [&automaton, &other_accepting, &nodes, &antichains, word_number](Node node) {
+      auto &antichain = antichains[node.state];
+      for (auto index: antichain) {
+        if (SubsetTable::IsSubset(nodes[index].subset.data(), node.subset.data(), word_number)) {
+          return false;
+        }
+      }
+      std::erase_if(antichain, [&nodes, &node, word_number](auto index) {
+        return SubsetTable::IsSubset(node.subset.data(), nodes[index].subset.data(), word_number);
+      });
+      antichain.push_back(nodes.size());
+      nodes.push_back(std::move(node));
+      return automaton.IsAccepting(nodes.back().state) &&
+             !SubsetTable::Intersects(nodes.back().subset.data(), other_accepting.data(), word_number);
+    };
+    auto get_word = [&nodes]() {
+      std::string word;
+      for (auto node = nodes.size() - 1; nodes[node].parent; node = *nodes[node].parent) {
+        word.push_back(nodes[node].symbol);
+      }
+      std::ranges::reverse(word);
+      return word;
+    };
+
+    Subset initial_subset(word_number);
+    SubsetTable::AddState(initial_subset.data(), other_automaton.initial_state());
+    if (add_node({automaton.initial_state(), std::move(initial_subset), std::nullopt, '\0'})) {
+      return get_word();
+    }
+    for (std::size_t node = 0; node < nodes.size(); ++node) {
+      std::map<char, std::vector<std::size_t>> successors;
+      for (const auto &transition: automaton.GetTransitions(nodes[node].state)) {
+        successors[transition.symbol[0]].push_back(transition.to_state);
+      }
+      // Only the members of the subset are expanded, so a step costs the number of their transitions.
+      std::map<char, Subset> other_successors;
+      SubsetTable::ForEachState(nodes[node].subset.data(), word_number, [&](std::size_t state) {
+        for (const auto &transition: other_automaton.GetTransitions(state)) {
+          if (successors.contains(transition.symbol[0])) {
+            auto &to_subset = other_successors.try_emplace(transition.symbol[0], word_number).first->second;
+            SubsetTable::AddState(to_subset.data(), transition.to_state);
+          }
+        }
+      });
+      for (const auto &[symbol, to_states]: successors) {
+        auto it = other_successors.find(symbol);
+        auto to_subset = it != other_successors.end() ? it->second : Subset(word_number);
+        for (auto to_state: to_states) {
+          if (add_node({to_state, to_subset, node, symbol})) {
+            return get_word();
+          }
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  bool NondeterministicAutomaton::IsSubsetOf(const NondeterministicAutomaton &other) const {
+    return !FindInclusionCounterexample(other);
+  }
+
+  std::optional<std::string>
+  NondeterministicAutomaton::FindDistinguishingWord(const NondeterministicAutomaton &other) const {
+    if (auto word = FindInclusionCounterexample(other)) {
+      return word;
+    }
+    return other.FindInclusionCounterexample(*this);
+  }
+
+  bool NondeterministicAutomaton::IsEquivalent(const NondeterministicAutomaton &other) const {
+    return !FindDistinguishingWord(other);
+  }
+
   NondeterministicAutomaton AutomatonVisitor::Process(const regex::Literal &regex) {
     return {2, 0, {1}, {{0, 1, std::string(1, regex.symbol)}}};
   }
@@ -437,13 +1074,137 @@ namespace automata {
     });
   }
 
-  DeterministicAutomaton RegexToMCDFA(const regex::Regex &expression, const std::vector<char> &alphabet) {
-    return NondeterministicAutomaton::FromRegex(expression).Determinize().MakeComplete(alphabet).Minimize();
+  namespace {
+    std::vector<std::size_t> MergePositions(const std::vector<std::size_t> &first,
+                                            const std::vector<std::size_t> &second) {
+      std::vector<std::size_t> result;
+      result.reserve(first.size() + second.size());
+      std::ranges::set_union(first, second, std::back_inserter(result));
+      return result;
+    }
+  }
+
+  GlushkovPositions GlushkovVisitor::Process(const regex::None &regex) {
+    return {};
+  }
+
+  GlushkovPositions GlushkovVisitor::Process(const regex::Empty &regex) {
+    return {.is_nullable = true, .first = {}, .last = {}};
+  }
+
+  GlushkovPositions GlushkovVisitor::Process(const regex::Literal &regex) {
+    auto position = symbols_.size();
+    symbols_.push_back(regex.symbol);
+    follow_.emplace_back();
+    return {false, {position}, {position}};
+  }
+
+  GlushkovPositions GlushkovVisitor::Process(const regex::Concatenation &regex, GlushkovPositions first,
+                                             GlushkovPositions second) {
+    AddFollowers(first.last, second.first);
+    return {first.is_nullable && second.is_nullable,
+            first.is_nullable ? MergePositions(first.first, second.first) : std::move(first.first),
+            second.is_nullable ? MergePositions(first.last, second.last) : std::move(second.last)};
+  }
+
+  GlushkovPositions GlushkovVisitor::Process(const regex::Alteration &regex, GlushkovPositions first,
+                                             GlushkovPositions second) {
+    return {first.is_nullable || second.is_nullable, MergePositions(first.first, second.first),
+            MergePositions(first.last, second.last)};
+  }
+
+  GlushkovPositions GlushkovVisitor::Process(const regex::KleeneStar &regex, GlushkovPositions inner) {
+    AddFollowers(inner.last, inner.first);
+    inner.is_nullable = true;
+    return inner;
+  }
+
+  void GlushkovVisitor::AddFollowers(const std::vector<std::size_t> &positions,
+                                     const std::vector<std::size_t> &followers) {
+    for (auto position: positions) {
+      follow_[position] = MergePositions(follow_[position], followers);
+    }
+  }
+
+  NondeterministicAutomaton GlushkovVisitor::GetAutomaton() {
+    auto positions = GetResult();
+    NondeterministicAutomaton automaton{symbols_.size() + 1, 0};
+    automaton.SetAccepting(0, positions.is_nullable);
+    for (auto position: positions.last) {
+      automaton.SetAccepting(position + 1);
+    }
+    for (auto position: positions.first) {
+      automaton.AddTransition(0, position + 1, std::string(1, symbols_[position]));
+    }
+    for (std::size_t position = 0; position < symbols_.size(); ++position) {
+      for (auto follower: follow_[position]) {
+        automaton.AddTransition(position + 1, follower + 1, std::string(1, symbols_[follower]));
+      }
+    }
+    return automaton;
+  }
+
+  namespace {
+    // Numbers the states in depth-first preorder from the initial state, following transitions in order of their
+    // symbols, and puts unreachable states last. Minimal complete automata of the same language come out equal.
+    DeterministicAutomaton RenumberDepthFirst(const DeterministicAutomaton &automaton) {
+      std::vector<std::optional<std::size_t>> renumbered(automaton.GetStateNumber());
+      std::size_t state_number = 0;
+      std::vector<std::pair<std::size_t, TransitionMap::Iterator>> path;
+      auto enter = [&](std::size_t state) {
+        renumbered[state] = state_number++;
+        path.emplace_back(state, automaton.GetTransitions(state).begin());
+      };
+      enter(automaton.initial_state());
+      while (!path.empty()) {
+        auto &[state, next_transition] = path.back();
+        if (next_transition == automaton.GetTransitions(state).end()) {
+          path.pop_back();
+          continue;
+        }
+        auto to_state = (*next_transition).to_state;
+        ++next_transition;
+        if (!renumbered[to_state]) {
+          enter(to_state);
+        }
+      }
+      for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+        if (!renumbered[state]) {
+          renumbered[state] = state_number++;
+        }
+      }
+      DeterministicAutomaton result{automaton.GetStateNumber(), 0};
+      for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+        result.SetAccepting(*renumbered[state], automaton.IsAccepting(state));
+      }
+      automaton.ForEachTransition([&result, &renumbered](auto from_state, auto to_state, auto transition_symbol) {
+        result.AddTransition(*renumbered[from_state], *renumbered[to_state], transition_symbol);
+      });
+      return result;
+    }
+  }
+
+  DeterministicAutomaton RegexToMCDFA(const regex::Regex &expression, const std::vector<char> &alphabet,
+                                      RegexConstruction construction) {
+    TraceSpan span("RegexToMCDFA");
+    DeterministicAutomaton determinized;
+    if (construction == RegexConstruction::kDerivatives) {
+      // Already complete, but completed again below so that it gets the same sink state as with the other
+      // constructions.
+      determinized = DeterministicAutomaton::FromRegexDerivatives(expression, alphabet);
+    } else {
+      auto automaton = NondeterministicAutomaton::FromRegex(expression, construction);
+      determinized = construction == RegexConstruction::kGlushkov ? automaton.DeterminizeSingleLetterTransitions()
+                                                                  : automaton.Determinize();
+    }
+    return RenumberDepthFirst(determinized.MakeComplete(alphabet).Minimize());
   }
 
-  regex::Regex RegexComplement(const regex::Regex &expression, const std::vector<char> &alphabet) {
+  regex::Regex RegexComplement(const regex::Regex &expression, const std::vector<char> &alphabet,
+                               bool simplify) {
+    TraceSpan span("RegexComplement");
     auto automata = NondeterministicAutomaton(RegexToMCDFA(expression, alphabet).Complement());
     automata.MakeSingleAcceptingState();
-    return automata.ToRegex();
+    return automata.ToRegex(simplify);
   }
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "batch_matcher.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <numeric>
+
+namespace automata {
+  namespace {
+    // Words of the bitmap, i.e. runs of 64 strings, below which another thread does not pay off.
+    constexpr std::size_t kMinWordsPerThread = 64;
+  }
+
+  std::size_t MatchBitmap::GetAcceptedNumber() const {
+    return std::accumulate(words_.begin(), words_.end(), std::size_t{0}, [](std::size_t sum, std::uint64_t word) {
+      return sum + std::popcount(word);
+    });
+  }
+
+  double BatchStatistics::GetBytesPerSecond() const {
+    return elapsed.count() ? byte_number * 1e9 / elapsed.count() : 0;
+  }
+
+  double BatchStatistics::GetStringsPerSecond() const {
+    return elapsed.count() ? string_number * 1e9 / elapsed.count() : 0;
+  }
+
+  BatchMatcher::BatchMatcher(std::shared_ptr<const CompiledDfa> dfa, std::size_t thread_number) :
+      BatchMatcher(std::move(dfa), LiteralPrefilter(), thread_number) {}
+
+  BatchMatcher::BatchMatcher(std::shared_ptr<const CompiledDfa> dfa, LiteralPrefilter prefilter,
+                             std::size_t thread_number) :
+      dfa_(std::move(dfa)), prefilter_(std::move(prefilter)), thread_number_(std::max<std::size_t>(thread_number, 1)) {
+    if (!dfa_) {
+      throw BadAutomatonException("No automaton to match against");
+    }
+  }
+
+  MatchBitmap BatchMatcher::Match(std::span<const std::string_view> strings) const {
+    return MatchStrings(strings.size(), [strings](std::size_t index) {
+      return strings[index];
+    });
+  }
+
+  MatchBitmap BatchMatcher::Match(std::string_view blob, std::span<const std::size_t> offsets) const {
+    // Checked here, since an exception thrown by a worker thread would terminate the program.
+    if (offsets.empty() || offsets.back() > blob.size()) {
+      throw InvalidInputException("Offsets do not fit the blob");
+    }
+    if (!std::ranges::is_sorted(offsets)) {
+      throw InvalidInputException("Offsets are not in order");
+    }
+    return MatchStrings(offsets.size() - 1, [blob, offsets](std::size_t index) {
+      return blob.substr(offsets[index], offsets[index + 1] - offsets[index]);
+    });
+  }
+
+  BatchStatistics BatchMatcher::GetStatistics() const {
+    return {batch_number_.load(), string_number_.load(), byte_number_.load(), prefiltered_number_.load(),
+            std::chrono::nanoseconds(elapsed_nanoseconds_.load())};
+  }
+
+  template<typename GetString>
+  MatchBitmap BatchMatcher::MatchStrings(std::size_t string_number, GetString &&get_string) const {
+    auto start = std::chrono::steady_clock::now();
+    MatchBitmap result(string_number);
+    std::atomic<std::size_t> byte_number = 0;
+    std::atomic<std::size_t> prefiltered_number = 0;
+    ParallelFor(result.words_.size(), thread_number_, [&](std::size_t begin, std::size_t end, std::size_t) {
+      std::size_t chunk_byte_number = 0;
+      std::size_t chunk_prefiltered_number = 0;
+      // Strings that passed the prefilter and their bits in the word.
+      std::array<std::string_view, 64> word_strings;
+      std::array<std::size_t, 64> word_bits;
+      for (auto word = begin; word < end; ++word) {
+        auto word_size = std::min<std::size_t>(string_number - word * 64, 64);
+        std::size_t candidate_number = 0;
+        for (std::size_t bit = 0; bit < word_size; ++bit) {
+          auto string = get_string(word * 64 + bit);
+          chunk_byte_number += string.size();
+          if (prefilter_.MayMatch(string)) {
+            word_strings[candidate_number] = string;
+            word_bits[candidate_number++] = bit;
+          }
+        }
+        chunk_prefiltered_number += word_size - candidate_number;
+        auto accepted = dfa_->AcceptsInterleaved(word_strings.data(), candidate_number);
+        if (candidate_number == word_size) {
+          result.words_[word] = accepted;
+          continue;
+        }
+        std::uint64_t bits = 0;
+        for (std::size_t candidate = 0; candidate < candidate_number; ++candidate) {
+          bits |= ((accepted >> candidate) & 1) << word_bits[candidate];
+        }
+        result.words_[word] = bits;
+      }
+      byte_number.fetch_add(chunk_byte_number, std::memory_order_relaxed);
+      prefiltered_number.fetch_add(chunk_prefiltered_number, std::memory_order_relaxed);
+    }, kMinWordsPerThread);
+
+    batch_number_.fetch_add(1, std::memory_order_relaxed);
+    string_number_.fetch_add(string_number, std::memory_order_relaxed);
+    byte_number_.fetch_add(byte_number.load(), std::memory_order_relaxed);
+    prefiltered_number_.fetch_add(prefiltered_number.load(), std::memory_order_relaxed);
+    elapsed_nanoseconds_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    return result;
+  }
+}
@@ -0,0 +1,328 @@
+#include "binary_format.h"
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace automata {
+  namespace {
+    constexpr std::array<char, 8> kMagic{'A', 'U', 'T', 'O', 'M', 'A', 'T', 'A'};
+    constexpr std::uint32_t kByteOrder = 0x01020304;
+
+    std::size_t AlignUp(std::size_t size) {
+      return (size + kBinaryAlignment - 1) / kBinaryAlignment * kBinaryAlignment;
+    }
+
+    std::size_t GetSectionIndex(BinarySection section) {
+      return static_cast<std::size_t>(section);
+    }
+
+    class ImageWriter {
+    public:
+      ImageWriter() : image_(sizeof(BinaryHeader)) {}
+
+      BinaryHeader &header() {
+        return header_;
+      }
+
+      template<typename T>
+      void AddSection(BinarySection section, std::span<const T> data) {
+        auto offset = image_.size();
+        auto size = data.size_bytes();
+        image_.resize(AlignUp(offset + size));
+        if (size) {
+          std::memcpy(image_.data() + offset, data.data(), size);
+        }
+        header_.sections[GetSectionIndex(section)] = {offset, size};
+      }
+
+      std::vector<std::byte> Finish() {
+        header_.magic = kMagic;
+        header_.version = kBinaryFormatVersion;
+        header_.byte_order = kByteOrder;
+        header_.file_size = image_.size();
+        header_.checksum = 0;
+        std::memcpy(image_.data(), &header_, sizeof(header_));
+        header_.checksum = ComputeBinaryChecksum(image_);
+        std::memcpy(image_.data(), &header_, sizeof(header_));
+        return std::move(image_);
+      }
+
+    private:
+      BinaryHeader header_;
+      std::vector<std::byte> image_;
+    };
+
+    template<typename T>
+    ImageWriter WriteAutomaton(const Automaton<T> &automaton, BinaryAutomatonKind kind) {
+      ImageWriter writer;
+      auto &header = writer.header();
+      header.kind = kind;
+      header.state_number = automaton.GetStateNumber();
+      header.initial_state = automaton.initial_state();
+      std::vector<std::uint64_t> is_accepting((automaton.GetStateNumber() + 63) / 64);
+      std::vector<std::uint64_t> transition_offsets{0};
+      std::vector<std::uint64_t> targets;
+      std::vector<std::uint64_t> label_offsets{0};
+      std::string labels;
+      for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+        if (automaton.IsAccepting(state)) {
+          is_accepting[state / 64] |= std::uint64_t{1} << (state % 64);
+        }
+        for (const auto &transition: automaton.GetTransitions(state)) {
+          targets.push_back(transition.to_state);
+          labels += transition.symbol;
+          label_offsets.push_back(labels.size());
+        }
+        transition_offsets.push_back(targets.size());
+      }
+      for (auto symbol: labels) {
+        auto byte = static_cast<unsigned char>(symbol);
+        header.alphabet[byte / 64] |= std::uint64_t{1} << (byte % 64);
+      }
+      header.transition_number = targets.size();
+      writer.AddSection(BinarySection::kAccepting, std::span<const std::uint64_t>(is_accepting));
+      writer.AddSection(BinarySection::kTransitionOffsets, std::span<const std::uint64_t>(transition_offsets));
+      writer.AddSection(BinarySection::kTargets, std::span<const std::uint64_t>(targets));
+      writer.AddSection(BinarySection::kLabelOffsets, std::span<const std::uint64_t>(label_offsets));
+      writer.AddSection(BinarySection::kLabels, std::span<const char>(labels));
+      return writer;
+    }
+
+    void WriteFile(const std::vector<std::byte> &image, const std::string &path) {
+      std::ofstream os(path, std::ios::binary | std::ios::trunc);
+      os.write(reinterpret_cast<const char *>(image.data()), static_cast<std::streamsize>(image.size()));
+      if (!os.flush()) {
+        throw std::system_error(errno, std::generic_category(), "Cannot write " + path);
+      }
+    }
+  }
+
+  std::uint64_t ComputeBinaryChecksum(std::span<const std::byte> image) {
+    std::uint64_t checksum = image.size();
+    auto mix = [&checksum](std::uint64_t word) {
+      checksum = std::rotl((checksum ^ word) * 0x9e3779b97f4a7c15, 29) * 0xbf58476d1ce4e5b9;
+    };
+    constexpr auto kChecksumOffset = offsetof(BinaryHeader, checksum);
+    for (std::size_t offset = 0; offset < image.size(); offset += sizeof(std::uint64_t)) {
+      std::uint64_t word = 0;
+      if (offset != kChecksumOffset) {
+        std::memcpy(&word, image.data() + offset, std::min(sizeof(word), image.size() - offset));
+      }
+      mix(word);
+    }
+    return checksum;
+  }
+
+  std::vector<std::byte> ToBinary(const DeterministicAutomaton &automaton) {
+    auto writer = WriteAutomaton(automaton, BinaryAutomatonKind::kDeterministic);
+    CompiledDfa compiled(automaton);
+    writer.header().compiled_initial_state = compiled.initial_state();
+    writer.AddSection(BinarySection::kCompiledTransitions, compiled.transitions());
+    writer.AddSection(BinarySection::kCompiledAccepting, compiled.is_accepting());
+    return writer.Finish();
+  }
+
+  std::vector<std::byte> ToBinary(const NondeterministicAutomaton &automaton) {
+    auto writer = WriteAutomaton(automaton, BinaryAutomatonKind::kNondeterministic);
+    writer.AddSection(BinarySection::kCompiledTransitions, std::span<const CompiledDfa::State>());
+    writer.AddSection(BinarySection::kCompiledAccepting, std::span<const std::uint64_t>());
+    return writer.Finish();
+  }
+
+  void SaveBinary(const DeterministicAutomaton &automaton, const std::string &path) {
+    WriteFile(ToBinary(automaton), path);
+  }
+
+  void SaveBinary(const NondeterministicAutomaton &automaton, const std::string &path) {
+    WriteFile(ToBinary(automaton), path);
+  }
+
+  MappedAutomaton MappedAutomaton::Open(const std::string &path, bool verify) {
+    auto descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+      throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+    }
+    struct stat status{};
+    if (fstat(descriptor, &status) != 0) {
+      auto error = errno;
+      close(descriptor);
+      throw std::system_error(error, std::generic_category(), "Cannot open " + path);
+    }
+    auto size = static_cast<std::size_t>(status.st_size);
+    if (size < sizeof(BinaryHeader)) {
+      close(descriptor);
+      throw InvalidInputException("Not an automaton image: " + path);
+    }
+    auto address = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+    auto error = errno;
+    close(descriptor);
+    if (address == MAP_FAILED) {
+      throw std::system_error(error, std::generic_category(), "Cannot map " + path);
+    }
+    std::shared_ptr<const void> mapping(address, [size](const void *address) {
+      munmap(const_cast<void *>(address), size);
+    });
+    return {mapping, {static_cast<const std::byte *>(address), size}, verify};
+  }
+
+  MappedAutomaton MappedAutomaton::FromBuffer(std::vector<std::byte> image, bool verify) {
+    auto buffer = std::make_shared<const std::vector<std::byte>>(std::move(image));
+    return {buffer, *buffer, verify};
+  }
+
+  MappedAutomaton::MappedAutomaton(std::shared_ptr<const void> storage, std::span<const std::byte> image,
+                                   bool verify) : storage_(std::move(storage)), image_(image) {
+    CheckLayout();
+    if (verify) {
+      Verify();
+    }
+  }
+
+  template<typename T>
+  std::span<const T> MappedAutomaton::GetSection(BinarySection section) const {
+    auto range = header().sections[GetSectionIndex(section)];
+    return {reinterpret_cast<const T *>(image_.data() + range.offset), range.size / sizeof(T)};
+  }
+
+  void MappedAutomaton::CheckLayout() const {
+    if (image_.size() < sizeof(BinaryHeader) ||
+        reinterpret_cast<std::uintptr_t>(image_.data()) % alignof(std::uint64_t) != 0) {
+      throw InvalidInputException("Not an automaton image");
+    }
+    const auto &header = this->header();
+    if (header.magic != kMagic) {
+      throw InvalidInputException("Not an automaton image");
+    }
+    if (header.version != kBinaryFormatVersion) {
+      throw InvalidInputException("Unsupported automaton image version " + std::to_string(header.version));
+    }
+    if (header.byte_order != kByteOrder) {
+      throw InvalidInputException("Automaton image has a different byte order");
+    }
+    if (header.file_size != image_.size()) {
+      throw InvalidInputException("Automaton image is truncated");
+    }
+    bool is_deterministic = header.kind == BinaryAutomatonKind::kDeterministic;
+    if (!is_deterministic && header.kind != BinaryAutomatonKind::kNondeterministic) {
+      throw InvalidInputException("Unknown automaton kind");
+    }
+    auto state_number = header.state_number;
+    auto transition_number = header.transition_number;
+    auto compiled_state_number = is_deterministic ? state_number + 1 : 0;
+    // Divisions keep the products below from overflowing.
+    if (state_number > image_.size() / sizeof(std::uint64_t) ||
+        transition_number > image_.size() / sizeof(std::uint64_t)) {
+      throw InvalidInputException("Automaton image is truncated");
+    }
+    const std::array<std::uint64_t, static_cast<std::size_t>(BinarySection::kSectionNumber)> expected_sizes{
+        (state_number + 63) / 64 * sizeof(std::uint64_t),
+        (state_number + 1) * sizeof(std::uint64_t),
+        transition_number * sizeof(std::uint64_t),
+        (transition_number + 1) * sizeof(std::uint64_t),
+        header.sections[GetSectionIndex(BinarySection::kLabels)].size,
+        compiled_state_number * CompiledDfa::kAlphabetSize * sizeof(CompiledDfa::State),
+        (compiled_state_number + 63) / 64 * sizeof(std::uint64_t)
+    };
+    for (std::size_t section = 0; section < expected_sizes.size(); ++section) {
+      auto range = header.sections[section];
+      if (range.size != expected_sizes[section] || range.offset % kBinaryAlignment != 0 ||
+          range.offset < sizeof(BinaryHeader) || range.offset > image_.size() ||
+          range.size > image_.size() - range.offset) {
+        throw InvalidInputException("Wrong layout of automaton image");
+      }
+    }
+    if ((state_number && header.initial_state >= state_number) ||
+        (is_deterministic && header.compiled_initial_state >= compiled_state_number)) {
+      throw InvalidInputException("Wrong initial state in automaton image");
+    }
+  }
+
+  void MappedAutomaton::Verify() const {
+    const auto &header = this->header();
+    if (ComputeBinaryChecksum(image_) != header.checksum) {
+      throw InvalidInputException("Checksum of automaton image does not match");
+    }
+    auto transition_offsets = GetSection<std::uint64_t>(BinarySection::kTransitionOffsets);
+    auto label_offsets = GetSection<std::uint64_t>(BinarySection::kLabelOffsets);
+    auto is_monotonic = [](std::span<const std::uint64_t> offsets, std::uint64_t last) {
+      return offsets.front() == 0 && offsets.back() == last && std::ranges::is_sorted(offsets);
+    };
+    if (!is_monotonic(transition_offsets, header.transition_number) ||
+        !is_monotonic(label_offsets, GetSection<char>(BinarySection::kLabels).size())) {
+      throw InvalidInputException("Wrong transitions in automaton image");
+    }
+    for (auto target: GetSection<std::uint64_t>(BinarySection::kTargets)) {
+      if (target >= header.state_number) {
+        throw InvalidInputException("Wrong transitions in automaton image");
+      }
+    }
+    if (header.kind == BinaryAutomatonKind::kDeterministic) {
+      for (std::size_t transition = 0; transition < header.transition_number; ++transition) {
+        if (label_offsets[transition + 1] - label_offsets[transition] != 1) {
+          throw InvalidInputException("Transition is not single-letter");
+        }
+      }
+      if (!GetCompiledDfa().HasValidTransitions()) {
+        throw InvalidInputException("Wrong transitions in automaton image");
+      }
+    }
+  }
+
+  bool MappedAutomaton::IsAccepting(std::size_t state) const {
+    return (GetSection<std::uint64_t>(BinarySection::kAccepting)[state / 64] >> (state % 64)) & 1;
+  }
+
+  std::span<const std::uint64_t> MappedAutomaton::GetTargets(std::size_t state) const {
+    auto offsets = GetSection<std::uint64_t>(BinarySection::kTransitionOffsets);
+    return GetSection<std::uint64_t>(BinarySection::kTargets).subspan(offsets[state],
+                                                                      offsets[state + 1] - offsets[state]);
+  }
+
+  std::string_view MappedAutomaton::GetLabel(std::size_t transition) const {
+    auto offsets = GetSection<std::uint64_t>(BinarySection::kLabelOffsets);
+    auto labels = GetSection<char>(BinarySection::kLabels);
+    return {labels.data() + offsets[transition], offsets[transition + 1] - offsets[transition]};
+  }
+
+  DeterministicAutomaton MappedAutomaton::ToDeterministic() const {
+    if (kind() != BinaryAutomatonKind::kDeterministic) {
+      throw BadAutomatonException("Automaton image is not deterministic");
+    }
+    DeterministicAutomaton automaton(GetStateNumber(), header().initial_state);
+    std::size_t transition = 0;
+    for (std::size_t state = 0; state < GetStateNumber(); ++state) {
+      automaton.SetAccepting(state, IsAccepting(state));
+      for (auto target: GetTargets(state)) {
+        automaton.AddTransition(state, target, GetLabel(transition++).front());
+      }
+    }
+    return automaton;
+  }
+
+  NondeterministicAutomaton MappedAutomaton::ToNondeterministic() const {
+    NondeterministicAutomaton automaton(GetStateNumber(), header().initial_state);
+    std::size_t transition = 0;
+    for (std::size_t state = 0; state < GetStateNumber(); ++state) {
+      automaton.SetAccepting(state, IsAccepting(state));
+      for (auto target: GetTargets(state)) {
+        automaton.AddTransition(state, target, std::string(GetLabel(transition++)));
+      }
+    }
+    return automaton;
+  }
+
+  CompiledDfa MappedAutomaton::GetCompiledDfa() const {
+    if (kind() != BinaryAutomatonKind::kDeterministic) {
+      throw BadAutomatonException("Automaton image is not deterministic");
+    }
+    return {GetSection<CompiledDfa::State>(BinarySection::kCompiledTransitions),
+            GetSection<std::uint64_t>(BinarySection::kCompiledAccepting),
+            static_cast<CompiledDfa::State>(header().compiled_initial_state), storage_};
+  }
+}
@@ -28,6 +28,7 @@ namespace cli {
   CLI::CLI() {
     AddCommandHandle<command::Create<regex::Regex>>("regex");
     AddCommandHandle<command::Create<automata::NondeterministicAutomaton>>("automaton");
+    AddCommandHandle<command::CreateFromFile>("automaton_file");
     AddCommandHandle<command::AddState<automata::NondeterministicAutomaton>>("add_state");
     AddCommandHandle<command::AddTransition<automata::NondeterministicAutomaton>>("add_transition");
     AddCommandHandle<command::Print>("print");
@@ -40,6 +41,10 @@ namespace cli {
     AddCommandHandle<command::ToNFA>("to_nfa");
     AddCommandHandle<command::ToMCDFA>("to_mcdfa");
     AddCommandHandle<command::Equivalence>("equiv");
+    AddCommandHandle<command::Save>("save");
+    AddCommandHandle<command::Load>("load");
+    AddCommandHandle<command::Stats>("stats");
+    AddCommandHandle<command::Trace>("trace");
   }
   std::size_t CLI::AddObject(cli::Object object) {
     std::size_t id = objects_.size();
@@ -0,0 +1,316 @@
+#include "compiled_dfa.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define AUTOMATA_X86_KERNELS
+#endif
+
+namespace automata {
+  namespace {
+    struct Tables {
+      std::vector<CompiledDfa::State> transitions;
+      std::vector<std::uint64_t> is_accepting;
+    };
+  }
+
+  CompiledDfa::CompiledDfa(const DeterministicAutomaton &automaton) {
+    if (automaton.GetStateNumber() >= std::numeric_limits<State>::max()) {
+      throw BadAutomatonException("Too many states to compile");
+    }
+    auto state_number = automaton.GetStateNumber() + 1;
+    auto tables = std::make_shared<Tables>();
+    auto &transitions = tables->transitions;
+    auto &is_accepting = tables->is_accepting;
+    transitions.assign(state_number * kAlphabetSize, kDeadState);
+    is_accepting.assign((state_number + 63) / 64, 0);
+    initial_state_ = automaton.initial_state() + 1;
+    for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+      if (automaton.IsAccepting(state)) {
+        is_accepting[(state + 1) / 64] |= std::uint64_t{1} << ((state + 1) % 64);
+      }
+    }
+    // States from which no accepting state is reachable are replaced by the dead state, so that matching
+    // can tell as early as possible that the input will not be accepted.
+    std::vector<std::vector<std::size_t>> predecessors(automaton.GetStateNumber());
+    automaton.ForEachTransition([&predecessors](auto from_state, auto to_state, auto transition_symbol) {
+      predecessors[to_state].push_back(from_state);
+    });
+    std::vector<bool> is_live(automaton.GetStateNumber());
+    std::vector<std::size_t> to_process;
+    for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+      if (automaton.IsAccepting(state)) {
+        is_live[state] = true;
+        to_process.push_back(state);
+      }
+    }
+    while (!to_process.empty()) {
+      auto state = to_process.back();
+      to_process.pop_back();
+      for (auto predecessor: predecessors[state]) {
+        if (!is_live[predecessor]) {
+          is_live[predecessor] = true;
+          to_process.push_back(predecessor);
+        }
+      }
+    }
+    if (!is_live[automaton.initial_state()]) {
+      initial_state_ = kDeadState;
+    }
+    automaton.ForEachTransition([&transitions, &is_live](auto from_state, auto to_state, auto transition_symbol) {
+      if (is_live[from_state] && is_live[to_state]) {
+        transitions[(from_state + 1) * kAlphabetSize + static_cast<unsigned char>(transition_symbol)] =
+            static_cast<State>(to_state + 1);
+      }
+    });
+    transitions_ = transitions;
+    is_accepting_ = is_accepting;
+    storage_ = std::move(tables);
+  }
+
+  CompiledDfa::CompiledDfa(std::span<const State> transitions, std::span<const std::uint64_t> is_accepting,
+                           State initial_state, std::shared_ptr<const void> storage) :
+      transitions_(transitions), is_accepting_(is_accepting), initial_state_(initial_state),
+      storage_(std::move(storage)) {
+    if (transitions_.empty() || transitions_.size() % kAlphabetSize != 0) {
+      throw BadAutomatonException("Transition table is not made of whole rows");
+    }
+    if (is_accepting_.size() != (GetStateNumber() + 63) / 64) {
+      throw BadAutomatonException("Sizes of accepting states and transitions differ");
+    }
+    if (initial_state_ >= GetStateNumber() || IsAccepting(kDeadState)) {
+      throw BadAutomatonException("Wrong initial or dead state");
+    }
+  }
+
+  bool CompiledDfa::HasValidTransitions() const {
+    return std::ranges::all_of(transitions_, [state_number = GetStateNumber()](State state) {
+      return state < state_number;
+    });
+  }
+
+  CompiledDfa::State CompiledDfa::Run(State state, std::string_view string) const {
+    const auto *table = transitions_.data();
+    for (char symbol: string) {
+      state = table[state * kAlphabetSize + static_cast<unsigned char>(symbol)];
+    }
+    return state;
+  }
+
+  namespace {
+    constexpr std::size_t kLaneNumber = 8;
+    // Scalar lanes check whether all of them are dead once per this many steps.
+    constexpr std::size_t kDeadCheckInterval = 16;
+
+    using States = std::array<CompiledDfa::State, CompiledDfa::kMaxInterleavedStrings>;
+
+    std::size_t GetMaxLength(const std::string_view *strings, std::size_t count) {
+      std::size_t max_length = 0;
+      for (std::size_t i = 0; i < count; ++i) {
+        max_length = std::max(max_length, strings[i].size());
+      }
+      return max_length;
+    }
+
+    // Strings shorter than the longest one keep their final state for the remaining steps. The dead state
+    // leads only to itself, so the lanes stop once all of them are in it.
+    void RunLanes(const CompiledDfa::State *table, const std::string_view *strings,
+                  CompiledDfa::State initial_state, CompiledDfa::State *states) {
+      std::fill(states, states + kLaneNumber, initial_state);
+      auto max_length = GetMaxLength(strings, kLaneNumber);
+      for (std::size_t begin = 0; begin < max_length; begin += kDeadCheckInterval) {
+        if (std::all_of(states, states + kLaneNumber, [](auto state) {
+          return state == CompiledDfa::kDeadState;
+        })) {
+          break;
+        }
+        for (auto position = begin; position < std::min(max_length, begin + kDeadCheckInterval); ++position) {
+          for (std::size_t lane = 0; lane < kLaneNumber; ++lane) {
+            if (position < strings[lane].size()) {
+              auto symbol = static_cast<unsigned char>(strings[lane][position]);
+              states[lane] = table[states[lane] * CompiledDfa::kAlphabetSize + symbol];
+            }
+          }
+        }
+      }
+    }
+
+    void RunScalar(const CompiledDfa::State *table, const std::string_view *strings, std::size_t count,
+                   CompiledDfa::State initial_state, States &states) {
+      for (std::size_t begin = 0; begin < count; begin += kLaneNumber) {
+        // The last group is padded with empty strings.
+        std::array<std::string_view, kLaneNumber> lanes;
+        std::copy(strings + begin, strings + std::min(count, begin + kLaneNumber), lanes.begin());
+        RunLanes(table, lanes.data(), initial_state, states.data() + begin);
+      }
+    }
+
+#ifdef AUTOMATA_X86_KERNELS
+    // The gather index is state * 256 + symbol, so it needs state < 2^23, and lengths are compared as 32-bit
+    // signed integers.
+    constexpr std::size_t kMaxAvx2StateNumber = std::size_t{1} << 23;
+    constexpr std::size_t kMaxAvx2Length = std::numeric_limits<std::int32_t>::max();
+    constexpr std::size_t kAvx2LaneNumber = 8;
+    // Symbols are transposed in blocks of this many positions, one row of all strings per position.
+    constexpr std::size_t kBlockLength = 16;
+
+    using SymbolBlock = std::array<std::array<std::uint8_t, CompiledDfa::kMaxInterleavedStrings>, kBlockLength>;
+
+    // Writes byte j of rows[i] to columns[j * column_stride + i]. Every round interleaves pairs of vectors in
+    // units twice as wide as the round before.
+    __attribute__((target("avx2")))
+    void Transpose16x16(const std::uint8_t *const *rows, std::uint8_t *columns, std::size_t column_stride) {
+      __m128i a[16];
+      __m128i b[16];
+      for (std::size_t i = 0; i < 16; ++i) {
+        a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[i]));
+      }
+      for (std::size_t i = 0; i < 8; ++i) {
+        b[2 * i] = _mm_unpacklo_epi8(a[2 * i], a[2 * i + 1]);
+        b[2 * i + 1] = _mm_unpackhi_epi8(a[2 * i], a[2 * i + 1]);
+      }
+      for (std::size_t i = 0; i < 4; ++i) {
+        for (std::size_t j = 0; j < 2; ++j) {
+          a[4 * i + 2 * j] = _mm_unpacklo_epi16(b[4 * i + j], b[4 * i + j + 2]);
+          a[4 * i + 2 * j + 1] = _mm_unpackhi_epi16(b[4 * i + j], b[4 * i + j + 2]);
+        }
+      }
+      for (std::size_t i = 0; i < 2; ++i) {
+        for (std::size_t j = 0; j < 4; ++j) {
+          b[8 * i + 2 * j] = _mm_unpacklo_epi32(a[8 * i + j], a[8 * i + j + 4]);
+          b[8 * i + 2 * j + 1] = _mm_unpackhi_epi32(a[8 * i + j], a[8 * i + j + 4]);
+        }
+      }
+      for (std::size_t j = 0; j < 8; ++j) {
+        a[2 * j] = _mm_unpacklo_epi64(b[j], b[j + 8]);
+        a[2 * j + 1] = _mm_unpackhi_epi64(b[j], b[j + 8]);
+      }
+      for (std::size_t i = 0; i < 16; ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(columns + i * column_stride), a[i]);
+      }
+    }
+
+    // Puts symbol begin + i of every string whose bit is set in lanes into symbols[i][string], in 16x16
+    // tiles. Strings ending inside a tile are copied into a zero-padded buffer first, and the symbols past
+    // their ends are never used.
+    __attribute__((target("avx2")))
+    void TransposeSymbols(const std::string_view *strings, std::size_t count, std::uint64_t lanes,
+                          std::size_t begin, std::size_t length, SymbolBlock &symbols) {
+      alignas(16) static constexpr std::array<std::uint8_t, 16> kZeros{};
+      alignas(16) std::array<std::array<std::uint8_t, 16>, 16> padded_rows;
+      std::array<const std::uint8_t *, 16> rows;
+      for (std::size_t group = 0; group * 16 < count; ++group) {
+        if (((lanes >> (group * 16)) & 0xffff) == 0) {
+          continue;
+        }
+        for (std::size_t offset = 0; offset < length; offset += 16) {
+          auto position = begin + offset;
+          for (std::size_t i = 0; i < 16; ++i) {
+            auto lane = group * 16 + i;
+            const auto &string = strings[lane];
+            rows[i] = kZeros.data();
+            if (((lanes >> lane) & 1) == 0 || string.size() <= position) {
+              continue;
+            }
+            rows[i] = reinterpret_cast<const std::uint8_t *>(string.data()) + position;
+            if (string.size() < position + 16) {
+              padded_rows[i] = kZeros;
+              std::memcpy(padded_rows[i].data(), rows[i], string.size() - position);
+              rows[i] = padded_rows[i].data();
+            }
+          }
+          Transpose16x16(rows.data(), &symbols[offset][group * 16], CompiledDfa::kMaxInterleavedStrings);
+        }
+      }
+    }
+
+    // Runs all strings at once, 8 per vector, with one gather per vector and step. A lane is active while
+    // its string has symbols left and its state is not dead; inactive lanes are masked out of the gathers,
+    // and matching stops once no lane is active.
+    __attribute__((target("avx2")))
+    void RunAvx2(const CompiledDfa::State *table, const std::string_view *strings, std::size_t count,
+                 CompiledDfa::State initial_state, States &states) {
+      constexpr std::size_t kVectorNumber = CompiledDfa::kMaxInterleavedStrings / kAvx2LaneNumber;
+      alignas(32) std::array<std::int32_t, CompiledDfa::kMaxInterleavedStrings> lengths{};
+      for (std::size_t i = 0; i < count; ++i) {
+        lengths[i] = static_cast<std::int32_t>(strings[i].size());
+      }
+      auto zero = _mm256_setzero_si256();
+      __m256i state_vectors[kVectorNumber];
+      __m256i length_vectors[kVectorNumber];
+      __m256i active[kVectorNumber];
+      for (std::size_t v = 0; v < kVectorNumber; ++v) {
+        state_vectors[v] = _mm256_set1_epi32(static_cast<std::int32_t>(initial_state));
+        length_vectors[v] = _mm256_load_si256(reinterpret_cast<const __m256i *>(&lengths[v * kAvx2LaneNumber]));
+        active[v] = initial_state == CompiledDfa::kDeadState ? zero : _mm256_cmpgt_epi32(length_vectors[v], zero);
+      }
+      alignas(32) SymbolBlock symbols;
+      auto max_length = GetMaxLength(strings, count);
+      for (std::size_t begin = 0; begin < max_length; begin += kBlockLength) {
+        std::uint64_t active_lanes = 0;
+        for (std::size_t v = 0; v < kVectorNumber; ++v) {
+          active_lanes |= std::uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(active[v]))) << (v * kAvx2LaneNumber);
+        }
+        if (active_lanes == 0) {
+          break;
+        }
+        auto length = std::min(kBlockLength, max_length - begin);
+        TransposeSymbols(strings, count, active_lanes, begin, length, symbols);
+        for (std::size_t offset = 0; offset < length; ++offset) {
+          auto next_position = _mm256_set1_epi32(static_cast<std::int32_t>(begin + offset + 1));
+          auto any_active = zero;
+          for (std::size_t v = 0; v < kVectorNumber; ++v) {
+            auto symbol_vector = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&symbols[offset][v * kAvx2LaneNumber])));
+            auto indices = _mm256_or_si256(_mm256_slli_epi32(state_vectors[v], 8), symbol_vector);
+            state_vectors[v] = _mm256_mask_i32gather_epi32(state_vectors[v], reinterpret_cast<const int *>(table),
+                                                           indices, active[v], 4);
+            active[v] = _mm256_andnot_si256(_mm256_cmpeq_epi32(state_vectors[v], zero), active[v]);
+            active[v] = _mm256_and_si256(active[v], _mm256_cmpgt_epi32(length_vectors[v], next_position));
+            any_active = _mm256_or_si256(any_active, active[v]);
+          }
+          if (_mm256_testz_si256(any_active, any_active)) {
+            break;
+          }
+        }
+      }
+      for (std::size_t v = 0; v < kVectorNumber; ++v) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&states[v * kAvx2LaneNumber]), state_vectors[v]);
+      }
+    }
+#endif
+  }
+
+  CompiledDfa::Kernel CompiledDfa::GetBestKernel() {
+#ifdef AUTOMATA_X86_KERNELS
+    static const Kernel kBestKernel = __builtin_cpu_supports("avx2") ? Kernel::kAvx2 : Kernel::kScalar;
+    return kBestKernel;
+#else
+    return Kernel::kScalar;
+#endif
+  }
+
+  std::uint64_t CompiledDfa::AcceptsInterleaved(const std::string_view *strings, std::size_t count,
+                                                Kernel kernel) const {
+    if (count > kMaxInterleavedStrings) {
+      throw InvalidInputException("Too many strings to match at once");
+    }
+    auto run = &RunScalar;
+#ifdef AUTOMATA_X86_KERNELS
+    if (kernel == Kernel::kAvx2 && GetBestKernel() == Kernel::kAvx2 && GetStateNumber() <= kMaxAvx2StateNumber &&
+        GetMaxLength(strings, count) <= kMaxAvx2Length) {
+      run = &RunAvx2;
+    }
+#endif
+    States states;
+    run(transitions_.data(), strings, count, initial_state_, states);
+    std::uint64_t result = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      result |= std::uint64_t{IsAccepting(states[i])} << i;
+    }
+    return result;
+  }
+}
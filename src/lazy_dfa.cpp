@@ -0,0 +1,123 @@
+#include "lazy_dfa.h"
+#include <array>
+#include <unordered_map>
+
+namespace automata {
+  namespace {
+    struct SubsetHash {
+      std::size_t operator()(const std::vector<std::size_t> &subset) const {
+        std::size_t hash = subset.size();
+        for (auto state: subset) {
+          hash ^= state + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+      }
+    };
+  }
+
+  struct LazyDfa::CachedState {
+    std::vector<std::size_t> subset;
+    bool is_accepting = false;
+    std::array<std::atomic<const CachedState *>, 256> next{};
+  };
+
+  struct LazyDfa::Cache {
+    std::vector<std::unique_ptr<CachedState>> states;
+    std::unordered_map<std::vector<std::size_t>, const CachedState *, SubsetHash> index;
+    std::size_t memory = 0;
+    const CachedState *initial_state = nullptr;
+  };
+
+  LazyDfa::LazyDfa(const NondeterministicAutomaton &automaton, std::size_t memory_limit) :
+      initial_state_(automaton.initial_state()), is_accepting_(automaton.is_accepting()),
+      transitions_(automaton.GetStateNumber()), memory_limit_(memory_limit) {
+    for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+      for (const auto &transition: automaton.GetTransitions(state)) {
+        if (transition.symbol.size() != 1) {
+          throw BadAutomatonException("Transition is not single-letter");
+        }
+        transitions_[state].emplace_back(transition.symbol[0], transition.to_state);
+      }
+      std::ranges::sort(transitions_[state]);
+    }
+    cache_.store(CreateCache());
+  }
+
+  LazyDfa::~LazyDfa() = default;
+
+  bool LazyDfa::AcceptsString(std::string_view string) const {
+    auto cache = cache_.load(std::memory_order_acquire);
+    const CachedState *state = cache->initial_state;
+    for (char symbol: string) {
+      auto next_state = state->next[static_cast<unsigned char>(symbol)].load(std::memory_order_acquire);
+      if (!next_state) {
+        next_state = AddTransition(cache, state, symbol);
+      }
+      state = next_state;
+    }
+    return state->is_accepting;
+  }
+
+  std::size_t LazyDfa::GetCachedStateNumber() const {
+    std::lock_guard lock(mutex_);
+    return cache_.load()->states.size();
+  }
+
+  const LazyDfa::CachedState *
+  LazyDfa::AddTransition(std::shared_ptr<Cache> &cache, const CachedState *state, char symbol) const {
+    std::lock_guard lock(mutex_);
+    auto current_cache = cache_.load(std::memory_order_relaxed);
+    if (current_cache != cache) {
+      auto old_cache = std::exchange(cache, std::move(current_cache));
+      state = GetOrAddState(*cache, state->subset);
+    }
+    auto &next = const_cast<CachedState *>(state)->next[static_cast<unsigned char>(symbol)];
+    if (auto next_state = next.load(std::memory_order_relaxed)) {
+      return next_state;
+    }
+
+    std::vector<std::size_t> next_subset;
+    for (auto nfa_state: state->subset) {
+      const auto &transitions = transitions_[nfa_state];
+      auto it = std::ranges::lower_bound(transitions, symbol, {}, &Transition<char>::symbol);
+      for (; it != transitions.end() && it->symbol == symbol; ++it) {
+        next_subset.push_back(it->to_state);
+      }
+    }
+    std::ranges::sort(next_subset);
+    next_subset.erase(std::ranges::unique(next_subset).begin(), next_subset.end());
+
+    if (cache->memory >= memory_limit_ && !cache->index.contains(next_subset)) {
+      auto subset = state->subset;
+      cache = CreateCache();
+      state = GetOrAddState(*cache, std::move(subset));
+      cache_.store(cache, std::memory_order_release);
+      cache_flush_number_.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto next_state = GetOrAddState(*cache, std::move(next_subset));
+    const_cast<CachedState *>(state)->next[static_cast<unsigned char>(symbol)].store(next_state,
+                                                                                       std::memory_order_release);
+    return next_state;
+  }
+
+  const LazyDfa::CachedState *LazyDfa::GetOrAddState(Cache &cache, std::vector<std::size_t> subset) const {
+    auto it = cache.index.find(subset);
+    if (it != cache.index.end()) {
+      return it->second;
+    }
+    auto state = std::make_unique<CachedState>();
+    state->is_accepting = std::ranges::any_of(subset, [this](auto nfa_state) { return is_accepting_[nfa_state]; });
+    state->subset = std::move(subset);
+    cache.memory += sizeof(CachedState) + 2 * state->subset.size() * sizeof(std::size_t);
+    auto result = state.get();
+    cache.index.emplace(result->subset, result);
+    cache.states.push_back(std::move(state));
+    return result;
+  }
+
+  std::shared_ptr<LazyDfa::Cache> LazyDfa::CreateCache() const {
+    auto cache = std::make_shared<Cache>();
+    cache->initial_state = GetOrAddState(*cache, {initial_state_});
+    return cache;
+  }
+}
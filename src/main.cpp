@@ -1,7 +1,73 @@
+#include "batch_matcher.h"
+#include "binary_format.h"
 #include "cli.h"
 #include "max_matching_prefix.h"
+#include <cstring>
 
-int main() {
+namespace {
+  // Lines are read and matched in blocks of at most this many lines or about this many bytes, so the memory
+  // used does not grow with the input.
+  constexpr std::size_t kBlockLineNumber = 1 << 16;
+  constexpr std::size_t kBlockByteNumber = 16 << 20;
+
+  // Prints 1 or 0 for every line of the standard input depending on whether the automaton accepts the whole
+  // line, and the throughput to the standard error.
+  void MatchLines(const automata::BatchMatcher &matcher) {
+    std::string blob;
+    std::vector<std::size_t> offsets;
+    std::string line;
+    for (bool is_read = true; is_read;) {
+      blob.clear();
+      offsets.assign(1, 0);
+      while (offsets.size() <= kBlockLineNumber && blob.size() < kBlockByteNumber
+             && (is_read = static_cast<bool>(std::getline(std::cin, line)))) {
+        blob += line;
+        offsets.push_back(blob.size());
+      }
+      if (offsets.size() == 1) {
+        break;
+      }
+      auto result = matcher.Match(blob, offsets);
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        std::cout << result[i] << '\n';
+      }
+    }
+    std::cout.flush();
+    auto statistics = matcher.GetStatistics();
+    std::cerr << statistics.string_number << " strings, " << statistics.byte_number << " bytes, "
+              << statistics.GetStringsPerSecond() << " strings/s, " << statistics.GetBytesPerSecond() << " bytes/s, "
+              << statistics.prefiltered_number << " rejected by the prefilter"
+              << std::endl;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  // automata --batch <regex in reverse Polish notation> [<thread number>]
+  // automata --batch-image <binary image of a deterministic automaton> [<thread number>]
+  if (argc >= 3 && (std::strcmp(argv[1], "--batch") == 0 || std::strcmp(argv[1], "--batch-image") == 0)) {
+    try {
+      auto thread_number = argc >= 4 ? std::stoul(argv[3]) : automata::GetDefaultThreadNumber();
+      if (std::strcmp(argv[1], "--batch") == 0) {
+        auto regex = regex::Regex::ParseReversePolish(argv[2]);
+        auto dfa = std::make_shared<const automata::CompiledDfa>(automata::RegexToMCDFA(regex, {}));
+        MatchLines(automata::BatchMatcher(dfa, automata::LiteralPrefilter(regex), thread_number));
+      } else {
+        auto image = automata::MappedAutomaton::Open(argv[2]);
+        auto dfa = std::make_shared<const automata::CompiledDfa>(image.GetCompiledDfa());
+        MatchLines(automata::BatchMatcher(dfa, thread_number));
+      }
+    } catch (const InvalidInputException &e) {
+      std::cerr << "invalid input: " << e.what() << std::endl;
+      return 1;
+    } catch (const automata::BadAutomatonException &e) {
+      std::cerr << "automaton has a wrong type: " << e.what() << std::endl;
+      return 1;
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
   std::string input_regex;
   std::string pattern;
   while (std::cin >> input_regex >> pattern) {
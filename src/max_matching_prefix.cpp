@@ -1,5 +1,6 @@
 #include <cassert>
 #include "max_matching_prefix.h"
+#include "statistics.h"
 
 MaxMatchingPrefixFinder::MaxMatchingPrefixFinder(const automata::NondeterministicAutomaton &automaton,
                                                  std::string_view pattern)
@@ -16,11 +17,13 @@ std::size_t MaxMatchingPrefixFinder::GetMaxMatchingPrefix(const regex::Regex &re
 std::size_t MaxMatchingPrefixFinder::ComputeMaxMatchingPrefix() {
   is_possible_prefix_[automaton_.initial_state()][0] = true;
   to_process_.emplace(automaton_.initial_state(), 0);
+  ++queue_push_number_;
   while (!to_process_.empty()) {
     auto[state, prefix_length] = to_process_.front();
     to_process_.pop();
     ProcessState(state, prefix_length);
   }
+  automata::CountEvent(automata::Counter::kPrefixQueuePushes, queue_push_number_);
   return max_matching_prefix_;
 }
 
@@ -41,6 +44,7 @@ void MaxMatchingPrefixFinder::ProcessTransition(size_t prefix_length, const auto
       !is_possible_prefix_[transition.to_state][prefix_length + 1]) {
     is_possible_prefix_[transition.to_state][prefix_length + 1] = true;
     to_process_.emplace(transition.to_state, prefix_length + 1);
+    ++queue_push_number_;
   }
 }
 
@@ -0,0 +1,60 @@
+#include "multi_pattern_matcher.h"
+#include "subset_construction.h"
+#include <algorithm>
+#include <map>
+
+namespace automata {
+  MultiPatternMatcher::MultiPatternMatcher(const std::vector<regex::Regex> &patterns, std::size_t thread_number) :
+      pattern_number_(patterns.size()), pattern_sets_{{}} {
+    // The initial state of a Glushkov automaton has no incoming transitions, so the initial states of all
+    // patterns can be merged into state 0 of the union.
+    NondeterministicAutomaton union_automaton{1, 0};
+    std::vector<std::vector<std::size_t>> state_patterns(1);
+    for (std::size_t pattern = 0; pattern < patterns.size(); ++pattern) {
+      auto automaton = NondeterministicAutomaton::FromRegex(patterns[pattern], RegexConstruction::kGlushkov);
+      auto offset = union_automaton.GetStateNumber() - 1;
+      auto get_state = [offset](std::size_t state) {
+        return state == 0 ? 0 : state + offset;
+      };
+      for (std::size_t state = 1; state < automaton.GetStateNumber(); ++state) {
+        union_automaton.AddState();
+        state_patterns.emplace_back();
+      }
+      for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+        if (automaton.IsAccepting(state)) {
+          union_automaton.SetAccepting(get_state(state));
+          state_patterns[get_state(state)].push_back(pattern);
+        }
+        for (const auto &transition: automaton.GetTransitions(state)) {
+          union_automaton.AddTransition(get_state(state), get_state(transition.to_state), transition.symbol);
+        }
+      }
+    }
+
+    std::vector<std::vector<std::size_t>> accepting_states;
+    auto determinized = SubsetConstruction(union_automaton).Determinize(thread_number, accepting_states);
+    std::map<std::vector<std::size_t>, std::size_t> pattern_set_indices{{{}, 0}};
+    std::vector<std::size_t> labels;
+    for (const auto &states: accepting_states) {
+      std::vector<std::size_t> pattern_set;
+      for (auto state: states) {
+        pattern_set.insert(pattern_set.end(), state_patterns[state].begin(), state_patterns[state].end());
+      }
+      std::ranges::sort(pattern_set);
+      pattern_set.erase(std::ranges::unique(pattern_set).begin(), pattern_set.end());
+      auto [it, inserted] = pattern_set_indices.emplace(pattern_set, pattern_sets_.size());
+      if (inserted) {
+        pattern_sets_.push_back(std::move(pattern_set));
+      }
+      labels.push_back(it->second);
+    }
+    determinized.MakeComplete({});
+    labels.resize(determinized.GetStateNumber());
+    auto minimized = determinized.MinimizeLabeled(labels, thread_number);
+
+    dfa_ = std::make_shared<const CompiledDfa>(minimized);
+    // State s of the minimized automaton is state s + 1 of the compiled one, and state 0 is dead.
+    pattern_set_indices_.assign(1, 0);
+    pattern_set_indices_.insert(pattern_set_indices_.end(), labels.begin(), labels.end());
+  }
+}
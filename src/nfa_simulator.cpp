@@ -0,0 +1,416 @@
+#include "nfa_simulator.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <set>
+
+namespace automata {
+  class NfaSimulator::Engine {
+  public:
+    virtual ~Engine() = default;
+
+    virtual bool AcceptsString(std::string_view string) const = 0;
+
+    virtual bool IsBitParallel() const = 0;
+  };
+
+  namespace {
+    using Word = std::uint64_t;
+
+    constexpr std::size_t kWordBits = 64;
+
+    void SetBit(Word *words, std::size_t bit) {
+      words[bit / kWordBits] |= Word{1} << (bit % kWordBits);
+    }
+
+    bool TestBit(const Word *words, std::size_t bit) {
+      return (words[bit / kWordBits] >> (bit % kWordBits)) & 1;
+    }
+
+    template<typename F>
+    void ForEachBit(const Word *words, std::size_t word_number, F &&function) {
+      for (std::size_t word = 0; word < word_number; ++word) {
+        for (auto bits = words[word]; bits; bits &= bits - 1) {
+          function(word * kWordBits + std::countr_zero(bits));
+        }
+      }
+    }
+
+    // Works on any automaton with transitions of length at most 1.
+    class GenericEngine : public NfaSimulator::Engine {
+    public:
+      explicit GenericEngine(const NondeterministicAutomaton &automaton) :
+          state_number_(automaton.GetStateNumber()), word_number_((state_number_ + kWordBits - 1) / kWordBits),
+          closures_(state_number_ * word_number_), accepting_(word_number_), initial_(word_number_),
+          has_symbol_(256 * word_number_), successor_offsets_(state_number_ + 1) {
+        std::vector<std::size_t> to_process;
+        for (std::size_t state = 0; state < state_number_; ++state) {
+          auto closure = &closures_[state * word_number_];
+          SetBit(closure, state);
+          to_process.push_back(state);
+          while (!to_process.empty()) {
+            auto current_state = to_process.back();
+            to_process.pop_back();
+            for (const auto &transition: automaton.GetTransitions(current_state)) {
+              if (transition.symbol.empty() && !TestBit(closure, transition.to_state)) {
+                SetBit(closure, transition.to_state);
+                to_process.push_back(transition.to_state);
+              }
+            }
+          }
+          if (automaton.IsAccepting(state)) {
+            SetBit(accepting_.data(), state);
+          }
+        }
+        Or(initial_.data(), &closures_[automaton.initial_state() * word_number_]);
+
+        for (std::size_t state = 0; state < state_number_; ++state) {
+          std::set<std::pair<unsigned char, std::size_t>> targets;
+          for (const auto &transition: automaton.GetTransitions(state)) {
+            if (!transition.symbol.empty()) {
+              targets.emplace(static_cast<unsigned char>(transition.symbol[0]), transition.to_state);
+            }
+          }
+          for (auto it = targets.begin(); it != targets.end();) {
+            auto symbol = it->first;
+            SetBit(&has_symbol_[symbol * word_number_], state);
+            successor_symbols_.push_back(symbol);
+            auto mask_offset = successor_masks_.size();
+            successor_masks_.resize(mask_offset + word_number_);
+            for (; it != targets.end() && it->first == symbol; ++it) {
+              Or(&successor_masks_[mask_offset], &closures_[it->second * word_number_]);
+            }
+          }
+          successor_offsets_[state + 1] = successor_symbols_.size();
+        }
+      }
+
+      bool AcceptsString(std::string_view string) const override {
+        std::vector<Word> active = initial_;
+        std::vector<Word> next(word_number_);
+        std::vector<Word> candidates(word_number_);
+        for (char symbol: string) {
+          auto has_symbol = &has_symbol_[static_cast<unsigned char>(symbol) * word_number_];
+          bool any_candidate = false;
+          for (std::size_t word = 0; word < word_number_; ++word) {
+            candidates[word] = active[word] & has_symbol[word];
+            any_candidate |= candidates[word] != 0;
+          }
+          if (!any_candidate) {
+            return false;
+          }
+          std::ranges::fill(next, 0);
+          ForEachBit(candidates.data(), word_number_, [&](std::size_t state) {
+            Or(next.data(), GetSuccessorMask(state, static_cast<unsigned char>(symbol)));
+          });
+          std::swap(active, next);
+        }
+        for (std::size_t word = 0; word < word_number_; ++word) {
+          if (active[word] & accepting_[word]) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      bool IsBitParallel() const override {
+        return false;
+      }
+
+    private:
+      void Or(Word *target, const Word *source) const {
+        for (std::size_t word = 0; word < word_number_; ++word) {
+          target[word] |= source[word];
+        }
+      }
+
+      const Word *GetSuccessorMask(std::size_t state, unsigned char symbol) const {
+        auto begin = successor_symbols_.begin() + successor_offsets_[state];
+        auto end = successor_symbols_.begin() + successor_offsets_[state + 1];
+        auto index = std::lower_bound(begin, end, symbol) - successor_symbols_.begin();
+        return &successor_masks_[index * word_number_];
+      }
+
+      std::size_t state_number_;
+      std::size_t word_number_;
+      std::vector<Word> closures_;
+      std::vector<Word> accepting_;
+      std::vector<Word> initial_;
+      std::vector<Word> has_symbol_;
+      std::vector<std::size_t> successor_offsets_;
+      std::vector<unsigned char> successor_symbols_;
+      std::vector<Word> successor_masks_;
+    };
+
+    // Scratch space of SparseEngine::AcceptsString, one per thread so that engines can be shared by threads.
+    // Steps are numbered across all calls on the thread, so marks left by earlier calls never need clearing.
+    struct SparseScratch {
+      std::vector<std::size_t> added_steps;
+      std::size_t step = 0;
+      std::vector<std::size_t> active;
+      std::vector<std::size_t> next;
+    };
+
+    // Works on any automaton with transitions of length at most 1, like GenericEngine, but keeps the active
+    // states as a list and the successors of a state by a symbol, closed under empty transitions, as a list
+    // of states, so that memory is linear in the size of the closures rather than quadratic in the number
+    // of states.
+    class SparseEngine : public NfaSimulator::Engine {
+    public:
+      explicit SparseEngine(const NondeterministicAutomaton &automaton) :
+          accepting_(automaton.is_accepting()), successor_offsets_(automaton.GetStateNumber() + 1),
+          stamps_(automaton.GetStateNumber()) {
+        auto state_number = automaton.GetStateNumber();
+        std::vector<std::size_t> closure_offsets(state_number + 1);
+        std::vector<std::size_t> closures;
+        std::vector<std::size_t> to_process;
+        for (std::size_t state = 0; state < state_number; ++state) {
+          ++stamp_;
+          stamps_[state] = stamp_;
+          closures.push_back(state);
+          to_process.push_back(state);
+          while (!to_process.empty()) {
+            auto current_state = to_process.back();
+            to_process.pop_back();
+            for (const auto &transition: automaton.GetTransitions(current_state)) {
+              if (transition.symbol.empty() && stamps_[transition.to_state] != stamp_) {
+                stamps_[transition.to_state] = stamp_;
+                closures.push_back(transition.to_state);
+                to_process.push_back(transition.to_state);
+              }
+            }
+          }
+          closure_offsets[state + 1] = closures.size();
+        }
+        AddClosure(initial_, closures, closure_offsets, automaton.initial_state());
+
+        target_offsets_.push_back(0);
+        for (std::size_t state = 0; state < state_number; ++state) {
+          std::set<std::pair<unsigned char, std::size_t>> targets;
+          for (const auto &transition: automaton.GetTransitions(state)) {
+            if (!transition.symbol.empty()) {
+              targets.emplace(static_cast<unsigned char>(transition.symbol[0]), transition.to_state);
+            }
+          }
+          for (auto it = targets.begin(); it != targets.end();) {
+            auto symbol = it->first;
+            successor_symbols_.push_back(symbol);
+            ++stamp_;
+            for (; it != targets.end() && it->first == symbol; ++it) {
+              AddClosure(targets_, closures, closure_offsets, it->second);
+            }
+            target_offsets_.push_back(targets_.size());
+          }
+          successor_offsets_[state + 1] = successor_symbols_.size();
+        }
+      }
+
+      bool AcceptsString(std::string_view string) const override {
+        thread_local SparseScratch scratch;
+        auto &added_steps = scratch.added_steps;
+        if (added_steps.size() < accepting_.size()) {
+          added_steps.resize(accepting_.size());
+        }
+        auto &active = scratch.active;
+        auto &next = scratch.next;
+        active.assign(initial_.begin(), initial_.end());
+        for (char symbol: string) {
+          auto step = ++scratch.step;
+          next.clear();
+          for (auto state: active) {
+            auto begin = successor_symbols_.begin() + successor_offsets_[state];
+            auto end = successor_symbols_.begin() + successor_offsets_[state + 1];
+            auto it = std::lower_bound(begin, end, static_cast<unsigned char>(symbol));
+            if (it == end || *it != static_cast<unsigned char>(symbol)) {
+              continue;
+            }
+            auto index = it - successor_symbols_.begin();
+            for (auto target = target_offsets_[index]; target < target_offsets_[index + 1]; ++target) {
+              if (added_steps[targets_[target]] != step) {
+                added_steps[targets_[target]] = step;
+                next.push_back(targets_[target]);
+              }
+            }
+          }
+          if (next.empty()) {
+            return false;
+          }
+          std::swap(active, next);
+        }
+        return std::ranges::any_of(active, [this](std::size_t state) {
+          return accepting_[state];
+        });
+      }
+
+      bool IsBitParallel() const override {
+        return false;
+      }
+
+    private:
+      // Appends the states of the closure of state that are not stamped with the current stamp.
+      void AddClosure(std::vector<std::size_t> &target, const std::vector<std::size_t> &closures,
+                      const std::vector<std::size_t> &closure_offsets, std::size_t state) {
+        for (auto index = closure_offsets[state]; index < closure_offsets[state + 1]; ++index) {
+          if (stamps_[closures[index]] != stamp_) {
+            stamps_[closures[index]] = stamp_;
+            target.push_back(closures[index]);
+          }
+        }
+      }
+
+      std::vector<bool> accepting_;
+      std::vector<std::size_t> initial_;
+      std::vector<std::size_t> successor_offsets_;
+      std::vector<unsigned char> successor_symbols_;
+      std::vector<std::size_t> target_offsets_;
+      std::vector<std::size_t> targets_;
+      // Used only while building.
+      std::vector<std::size_t> stamps_;
+      std::size_t stamp_ = 0;
+    };
+
+    // Requires an epsilon-free automaton with single-letter transitions in which all transitions entering
+    // a state have the same symbol, and the initial state has no entering transitions.
+    template<std::size_t Words>
+    class GlushkovEngine : public NfaSimulator::Engine {
+    public:
+      using Mask = std::array<Word, Words>;
+
+      explicit GlushkovEngine(const NondeterministicAutomaton &automaton) :
+          chunk_number_((automaton.GetStateNumber() + 7) / 8), follow_tables_(chunk_number_ * 256),
+          symbol_masks_{}, initial_{}, accepting_{} {
+        std::vector<Mask> follow(automaton.GetStateNumber());
+        for (std::size_t state = 0; state < automaton.GetStateNumber(); ++state) {
+          for (const auto &transition: automaton.GetTransitions(state)) {
+            SetBit(follow[state].data(), transition.to_state);
+            SetBit(symbol_masks_[static_cast<unsigned char>(transition.symbol[0])].data(), transition.to_state);
+          }
+          if (automaton.IsAccepting(state)) {
+            SetBit(accepting_.data(), state);
+          }
+        }
+        SetBit(initial_.data(), automaton.initial_state());
+        for (std::size_t chunk = 0; chunk < chunk_number_; ++chunk) {
+          for (std::size_t bits = 1; bits < 256; ++bits) {
+            auto lowest_bit = std::countr_zero(bits);
+            auto &entry = follow_tables_[chunk * 256 + bits];
+            entry = follow_tables_[chunk * 256 + (bits & (bits - 1))];
+            auto state = chunk * 8 + lowest_bit;
+            if (state < follow.size()) {
+              for (std::size_t word = 0; word < Words; ++word) {
+                entry[word] |= follow[state][word];
+              }
+            }
+          }
+        }
+      }
+
+      bool AcceptsString(std::string_view string) const override {
+        Mask active = initial_;
+        for (char symbol: string) {
+          Mask next{};
+          for (std::size_t chunk = 0; chunk < chunk_number_; ++chunk) {
+            auto bits = (active[chunk / 8] >> (chunk % 8 * 8)) & 0xff;
+            const auto &follow = follow_tables_[chunk * 256 + bits];
+            for (std::size_t word = 0; word < Words; ++word) {
+              next[word] |= follow[word];
+            }
+          }
+          const auto &symbol_mask = symbol_masks_[static_cast<unsigned char>(symbol)];
+          Word any_active = 0;
+          for (std::size_t word = 0; word < Words; ++word) {
+            active[word] = next[word] & symbol_mask[word];
+            any_active |= active[word];
+          }
+          if (!any_active) {
+            return false;
+          }
+        }
+        for (std::size_t word = 0; word < Words; ++word) {
+          if (active[word] & accepting_[word]) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      bool IsBitParallel() const override {
+        return true;
+      }
+
+    private:
+      std::size_t chunk_number_;
+      std::vector<Mask> follow_tables_;
+      std::array<Mask, 256> symbol_masks_;
+      Mask initial_;
+      Mask accepting_;
+    };
+
+    // Removes unreachable states and splits states entered by several symbols into one copy per symbol, so
+    // that the result can be run by GlushkovEngine. Gives up once more than max_state_number states are needed.
+    std::optional<NondeterministicAutomaton>
+    MakeHomogeneous(const NondeterministicAutomaton &automaton, std::size_t max_state_number) {
+      // Copies are identified by (original state, entering symbol); the initial state gets its own copy
+      // keyed by symbol -1 which nothing enters.
+      std::map<std::pair<std::size_t, int>, std::size_t> copy_index;
+      std::vector<std::pair<std::size_t, int>> copies;
+      auto get_copy = [&](std::size_t state, int symbol) {
+        auto [it, inserted] = copy_index.emplace(std::pair(state, symbol), copies.size());
+        if (inserted) {
+          copies.emplace_back(state, symbol);
+        }
+        return it->second;
+      };
+      get_copy(automaton.initial_state(), -1);
+      std::vector<NondeterministicAutomaton::ExtendedTransition> transitions;
+      for (std::size_t copy = 0; copy < copies.size() && copies.size() <= max_state_number; ++copy) {
+        for (const auto &transition: automaton.GetTransitions(copies[copy].first)) {
+          auto to_copy = get_copy(transition.to_state, static_cast<unsigned char>(transition.symbol[0]));
+          transitions.push_back({copy, to_copy, transition.symbol});
+        }
+      }
+      if (copies.size() > max_state_number) {
+        return std::nullopt;
+      }
+      std::vector<std::size_t> accepting_states;
+      for (std::size_t copy = 0; copy < copies.size(); ++copy) {
+        if (automaton.IsAccepting(copies[copy].first)) {
+          accepting_states.push_back(copy);
+        }
+      }
+      return NondeterministicAutomaton{copies.size(), 0, accepting_states, transitions};
+    }
+  }
+
+  NfaSimulator::NfaSimulator(const NondeterministicAutomaton &automaton) {
+    auto split = automaton;
+    split.SplitTransitions();
+    if (split.GetStateNumber() <= kMaxBitParallelStates) {
+      if (auto homogeneous = MakeHomogeneous(split.RemoveEmptyTransitions(), kMaxBitParallelStates)) {
+        if (homogeneous->GetStateNumber() <= 64) {
+          engine_ = std::make_unique<GlushkovEngine<1>>(*homogeneous);
+        } else {
+          engine_ = std::make_unique<GlushkovEngine<kMaxBitParallelStates / 64>>(*homogeneous);
+        }
+        return;
+      }
+    }
+    if (split.GetStateNumber() <= kMaxDenseStates) {
+      engine_ = std::make_unique<GenericEngine>(split);
+    } else {
+      engine_ = std::make_unique<SparseEngine>(split);
+    }
+  }
+
+  NfaSimulator::~NfaSimulator() = default;
+
+  bool NfaSimulator::AcceptsString(std::string_view string) const {
+    return engine_->AcceptsString(string);
+  }
+
+  bool NfaSimulator::IsBitParallel() const {
+    return engine_->IsBitParallel();
+  }
+}
@@ -0,0 +1,94 @@
+#include "parallel.h"
+#include <condition_variable>
+#include <utility>
+
+namespace automata {
+  // Tasks of one Run call that are not done yet. Finished tasks count down under the lock, so the caller
+  // cannot return and destroy the group while the last of them still holds it.
+  struct ThreadPool::TaskGroup {
+    std::mutex mutex;
+    std::condition_variable is_done;
+    std::size_t remaining_number;
+  };
+
+  struct ThreadPool::Worker {
+    std::condition_variable has_task;
+    void (*run)(void *, std::size_t) = nullptr;
+    void *context = nullptr;
+    std::size_t task = 0;
+    TaskGroup *group = nullptr;
+  };
+
+  ThreadPool &ThreadPool::Get() {
+    // Leaked on purpose: joining at exit would race with the destruction of statics the threads may still
+    // use, such as the trace registry.
+    static auto *pool = new ThreadPool;
+    return *pool;
+  }
+
+  void ThreadPool::Run(std::size_t task_number, void (*run)(void *, std::size_t), void *context) {
+    if (task_number <= 1) {
+      if (task_number == 1) {
+        run(context, 0);
+      }
+      return;
+    }
+    TaskGroup group{.remaining_number = task_number - 1};
+    {
+      std::lock_guard lock(mutex_);
+      for (std::size_t task = 1; task < task_number; ++task) {
+        Worker *worker;
+        bool is_new = idle_workers_.empty();
+        if (is_new) {
+          workers_.push_back(std::make_unique<Worker>());
+          worker = workers_.back().get();
+        } else {
+          worker = idle_workers_.back();
+          idle_workers_.pop_back();
+        }
+        worker->run = run;
+        worker->context = context;
+        worker->task = task;
+        worker->group = &group;
+        if (is_new) {
+          std::thread([this, worker] {
+            Work(*worker);
+          }).detach();
+        } else {
+          worker->has_task.notify_one();
+        }
+      }
+    }
+    run(context, 0);
+    std::unique_lock lock(group.mutex);
+    group.is_done.wait(lock, [&group] {
+      return group.remaining_number == 0;
+    });
+  }
+
+  std::size_t ThreadPool::GetThreadNumber() const {
+    std::lock_guard lock(mutex_);
+    return workers_.size();
+  }
+
+  void ThreadPool::Work(Worker &worker) {
+    std::unique_lock lock(mutex_);
+    while (true) {
+      worker.has_task.wait(lock, [&worker] {
+        return worker.run != nullptr;
+      });
+      auto run = std::exchange(worker.run, nullptr);
+      auto group = worker.group;
+      lock.unlock();
+      run(worker.context, worker.task);
+      {
+        std::lock_guard group_lock(group->mutex);
+        if (--group->remaining_number == 0) {
+          group->is_done.notify_one();
+        }
+      }
+      lock.lock();
+      idle_workers_.push_back(&worker);
+    }
+  }
+}
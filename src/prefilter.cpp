@@ -0,0 +1,168 @@
+#include "prefilter.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace automata {
+  namespace {
+    // Bounds on exact sets and on the alternatives a prefilter looks for.
+    constexpr std::size_t kMaxLiteralNumber = 16;
+    constexpr std::size_t kMaxLiteralLength = 256;
+
+    void Normalize(std::vector<std::string> &literals) {
+      std::ranges::sort(literals);
+      literals.erase(std::ranges::unique(literals).begin(), literals.end());
+    }
+
+    // Joins every string of the first set with every string of the second one, unless the result gets too
+    // large.
+    std::optional<std::vector<std::string>> Join(const std::vector<std::string> &first,
+                                                 const std::vector<std::string> &second) {
+      if (first.size() * second.size() > kMaxLiteralNumber) {
+        return std::nullopt;
+      }
+      std::vector<std::string> result;
+      for (const auto &prefix: first) {
+        for (const auto &suffix: second) {
+          if (prefix.size() + suffix.size() > kMaxLiteralLength) {
+            return std::nullopt;
+          }
+          result.push_back(prefix + suffix);
+        }
+      }
+      Normalize(result);
+      return result;
+    }
+
+    // Unites the sets, unless the result gets too large.
+    std::optional<std::vector<std::string>> Unite(const std::vector<std::string> &first,
+                                                  const std::vector<std::string> &second) {
+      std::vector<std::string> result = first;
+      result.insert(result.end(), second.begin(), second.end());
+      Normalize(result);
+      if (result.size() > kMaxLiteralNumber) {
+        return std::nullopt;
+      }
+      return result;
+    }
+
+    LiteralFactors FromExact(std::vector<std::string> exact) {
+      return {exact, exact, exact, exact};
+    }
+
+    // A set of alternatives is as selective as its shortest string; fewer strings are cheaper to look for.
+    bool IsBetter(const std::vector<std::string> &first, const std::vector<std::string> &second) {
+      auto get_min_length = [](const std::vector<std::string> &literals) {
+        std::size_t min_length = std::numeric_limits<std::size_t>::max();
+        for (const auto &literal: literals) {
+          min_length = std::min(min_length, literal.size());
+        }
+        return min_length;
+      };
+      auto first_length = get_min_length(first);
+      auto second_length = get_min_length(second);
+      return first_length != second_length ? first_length > second_length : first.size() < second.size();
+    }
+  }
+
+  LiteralFactors RequiredLiteralVisitor::Process(const regex::None &) {
+    return FromExact({});
+  }
+
+  LiteralFactors RequiredLiteralVisitor::Process(const regex::Empty &) {
+    return FromExact({""});
+  }
+
+  LiteralFactors RequiredLiteralVisitor::Process(const regex::Literal &regex) {
+    return FromExact({std::string(1, regex.symbol)});
+  }
+
+  LiteralFactors RequiredLiteralVisitor::Process(const regex::Concatenation &, LiteralFactors first,
+                                                 LiteralFactors second) {
+    if (first.exact && second.exact) {
+      if (auto exact = Join(*first.exact, *second.exact)) {
+        return FromExact(std::move(*exact));
+      }
+    }
+    LiteralFactors result;
+    result.prefixes = first.prefixes;
+    if (first.exact) {
+      result.prefixes = Join(*first.exact, second.prefixes).value_or(first.prefixes);
+    }
+    result.suffixes = second.suffixes;
+    if (second.exact) {
+      result.suffixes = Join(first.suffixes, *second.exact).value_or(second.suffixes);
+    }
+    result.required = IsBetter(first.required, second.required) ? first.required : second.required;
+    if (auto joint = Join(first.suffixes, second.prefixes); joint && IsBetter(*joint, result.required)) {
+      result.required = std::move(*joint);
+    }
+    for (auto *affix: {&result.prefixes, &result.suffixes}) {
+      if (IsBetter(*affix, result.required)) {
+        result.required = *affix;
+      }
+    }
+    return result;
+  }
+
+  LiteralFactors RequiredLiteralVisitor::Process(const regex::Alteration &, LiteralFactors first,
+                                                 LiteralFactors second) {
+    if (first.exact && second.exact) {
+      if (auto exact = Unite(*first.exact, *second.exact)) {
+        return FromExact(std::move(*exact));
+      }
+    }
+    LiteralFactors result;
+    result.prefixes = Unite(first.prefixes, second.prefixes).value_or(result.prefixes);
+    result.suffixes = Unite(first.suffixes, second.suffixes).value_or(result.suffixes);
+    result.required = Unite(first.required, second.required).value_or(result.required);
+    return result;
+  }
+
+  LiteralFactors RequiredLiteralVisitor::Process(const regex::KleeneStar &, LiteralFactors) {
+    return {};
+  }
+
+  std::vector<std::string> GetRequiredLiterals(const regex::Regex &expression) {
+    RequiredLiteralVisitor visitor;
+    expression.Visit(visitor);
+    auto literals = visitor.GetResult().required;
+    if (std::ranges::find(literals, "") != literals.end()) {
+      return {""};
+    }
+    return literals;
+  }
+
+  LiteralPrefilter::LiteralPrefilter(std::vector<std::string> literals) : literals_(std::move(literals)) {
+    Normalize(literals_);
+    passes_everything_ = std::ranges::find(literals_, "") != literals_.end();
+    if (passes_everything_) {
+      literals_ = {""};
+    }
+  }
+
+  LiteralPrefilter::LiteralPrefilter(const regex::Regex &expression) : LiteralPrefilter(
+      GetRequiredLiterals(expression)) {}
+
+  bool LiteralPrefilter::MayMatch(std::string_view string) const {
+    if (passes_everything_) {
+      return true;
+    }
+    for (const auto &literal: literals_) {
+      if (literal.size() > string.size()) {
+        continue;
+      }
+      auto last = string.data() + string.size() - literal.size();
+      for (auto position = string.data(); position <= last; ++position) {
+        position = static_cast<const char *>(std::memchr(position, literal[0], last - position + 1));
+        if (!position) {
+          break;
+        }
+        if (std::memcmp(position + 1, literal.data() + 1, literal.size() - 1) == 0) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+}
@@ -0,0 +1,185 @@
+#include "product.h"
+#include "parallel.h"
+#include "statistics.h"
+#include <algorithm>
+#include <atomic>
+#include <unordered_set>
+
+namespace automata {
+  namespace {
+    // Tuples of a level expanded by one thread at least.
+    constexpr std::size_t kMinChunkSize = 256;
+    // Levels smaller than this are expanded on the calling thread. Most levels of a product are small, and
+    // waking the threads of the pool for each of them costs more than it saves.
+    constexpr std::size_t kMinParallelLevelSize = 8 * kMinChunkSize;
+
+    // Interns tuples of states stored back to back in a single vector.
+    class TupleTable {
+    public:
+      explicit TupleTable(std::size_t width) : width_(width), indices_(0, Hash{this}, Equal{this}) {}
+
+      TupleTable(const TupleTable &) = delete;
+
+      TupleTable &operator=(const TupleTable &) = delete;
+
+      // Returns the index of the tuple and whether it was added.
+      std::pair<std::size_t, bool> Insert(const std::size_t *tuple) {
+        tuples_.insert(tuples_.end(), tuple, tuple + width_);
+        auto [it, inserted] = indices_.insert(GetTupleNumber() - 1);
+        if (!inserted) {
+          tuples_.resize(tuples_.size() - width_);
+        }
+        return {*it, inserted};
+      }
+
+      const std::size_t *GetTuple(std::size_t index) const {
+        return &tuples_[index * width_];
+      }
+
+      std::size_t GetTupleNumber() const {
+        return tuples_.size() / width_;
+      }
+
+    private:
+      struct Hash {
+        const TupleTable *table;
+
+        std::size_t operator()(std::size_t index) const {
+          std::size_t hash = 0;
+          auto tuple = table->GetTuple(index);
+          for (std::size_t i = 0; i < table->width_; ++i) {
+            hash ^= tuple[i] + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+          }
+          return hash;
+        }
+      };
+
+      struct Equal {
+        const TupleTable *table;
+
+        bool operator()(std::size_t first, std::size_t second) const {
+          return std::equal(table->GetTuple(first), table->GetTuple(first) + table->width_,
+                            table->GetTuple(second));
+        }
+      };
+
+      std::size_t width_;
+      std::vector<std::size_t> tuples_;
+      std::unordered_set<std::size_t, Hash, Equal> indices_;
+    };
+
+    struct Successor {
+      std::size_t from_state;
+      char symbol;
+    };
+
+    // Successors found by one thread; the i-th successor tuple starts at tuples[i * width].
+    struct Chunk {
+      std::vector<Successor> successors;
+      std::vector<std::size_t> tuples;
+    };
+  }
+
+  ProductBuilder::ProductBuilder(std::vector<const DeterministicAutomaton *> automata, std::size_t thread_number) :
+      automata_(std::move(automata)), thread_number_(std::max<std::size_t>(thread_number, 1)) {
+    if (automata_.empty()) {
+      throw BadAutomatonException("Product of no automata");
+    }
+  }
+
+  DeterministicAutomaton ProductBuilder::Build() const {
+    DeterministicAutomaton result{1, 0};
+    Explore(&result);
+    return result;
+  }
+
+  bool ProductBuilder::IsEmpty() const {
+    return !Explore(nullptr);
+  }
+
+  bool ProductBuilder::Explore(DeterministicAutomaton *result) const {
+    auto width = automata_.size();
+    auto is_accepting = [this, width](const std::size_t *tuple) {
+      for (std::size_t i = 0; i < width; ++i) {
+        if (!automata_[i]->IsAccepting(tuple[i])) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    TupleTable table(width);
+    std::vector<std::size_t> initial_tuple;
+    for (auto automaton: automata_) {
+      initial_tuple.push_back(automaton->initial_state());
+    }
+    table.Insert(initial_tuple.data());
+    bool has_accepting = is_accepting(initial_tuple.data());
+    if (!result && has_accepting) {
+      CountEvent(Counter::kProductTuples);
+      return true;
+    }
+    if (result) {
+      result->SetAccepting(0, has_accepting);
+    }
+
+    std::vector<Chunk> chunks(thread_number_);
+    std::atomic<bool> stop = false;
+    for (std::size_t level_begin = 0, level_end = 1; level_begin < level_end;
+         level_begin = level_end, level_end = table.GetTupleNumber()) {
+      // The table is only read while the level is expanded, and only written while the chunks are merged.
+      auto level_size = level_end - level_begin;
+      auto level_thread_number = level_size < kMinParallelLevelSize ? 1 : thread_number_;
+      ParallelFor(level_size, level_thread_number, [&](std::size_t begin, std::size_t end, std::size_t index) {
+        auto &chunk = chunks[index];
+        chunk.successors.clear();
+        chunk.tuples.clear();
+        for (auto state = level_begin + begin; state < level_begin + end; ++state) {
+          if (stop.load(std::memory_order_relaxed)) {
+            return;
+          }
+          auto tuple = table.GetTuple(state);
+          for (auto transition: automata_[0]->GetTransitions(tuple[0])) {
+            auto offset = chunk.tuples.size();
+            chunk.tuples.push_back(transition.to_state);
+            for (std::size_t i = 1; i < width; ++i) {
+              auto next_state = automata_[i]->GetNextState(tuple[i], transition.symbol);
+              if (!next_state) {
+                break;
+              }
+              chunk.tuples.push_back(*next_state);
+            }
+            if (chunk.tuples.size() != offset + width) {
+              chunk.tuples.resize(offset);
+              continue;
+            }
+            chunk.successors.push_back({state, transition.symbol});
+            if (!result && is_accepting(&chunk.tuples[offset])) {
+              stop.store(true, std::memory_order_relaxed);
+            }
+          }
+        }
+      }, kMinChunkSize);
+      if (stop.load(std::memory_order_relaxed)) {
+        CountEvent(Counter::kProductTuples, table.GetTupleNumber());
+        return true;
+      }
+
+      for (std::size_t index = 0; index < GetChunkNumber(level_size, level_thread_number, kMinChunkSize); ++index) {
+        const auto &chunk = chunks[index];
+        for (std::size_t i = 0; i < chunk.successors.size(); ++i) {
+          auto [to_state, inserted] = table.Insert(&chunk.tuples[i * width]);
+          if (result) {
+            if (inserted) {
+              has_accepting |= is_accepting(&chunk.tuples[i * width]);
+              result->AddState(is_accepting(&chunk.tuples[i * width]));
+            }
+            result->AddTransition(chunk.successors[i].from_state, to_state, chunk.successors[i].symbol);
+          }
+        }
+      }
+    }
+    CountEvent(Counter::kProductTuples, table.GetTupleNumber());
+    return has_accepting;
+  }
+}
@@ -1,9 +1,12 @@
 #include "regex.h"
 #include "automaton.h"
+#include "trace.h"
 #include "util.h"
 #include <string>
 #include <vector>
 #include <variant>
+#include <set>
+#include <limits>
 #include <regex.h>
 
 
@@ -46,7 +49,51 @@ namespace regex {
     os << '*';
   }
 
-  Regex Regex::Parse(const std::string &input) {
+  NodeStore::~NodeStore() {
+    for (auto node: nodes_) {
+      node->~RegexNode();
+    }
+  }
+
+  RegexPtr NodeStore::Import(RegexPtr node) {
+    std::unordered_map<RegexPtr, RegexPtr> imported;
+    return Import(node, imported);
+  }
+
+  RegexPtr NodeStore::Import(RegexPtr node, std::unordered_map<RegexPtr, RegexPtr> &imported) {
+    if (node->store_ == this) {
+      return node;
+    }
+    auto it = imported.find(node);
+    if (it != imported.end()) {
+      return it->second;
+    }
+    std::vector<RegexPtr> children;
+    for (auto child: node->children()) {
+      children.push_back(Import(child, imported));
+    }
+    return imported[node] = node->CopyTo(*this, children);
+  }
+
+  std::size_t NodeStore::GetNodeNumber() const {
+    std::lock_guard lock(mutex_);
+    return nodes_.size();
+  }
+
+  void *NodeStore::Allocate(std::size_t size, std::size_t alignment) {
+    chunk_used_ = (chunk_used_ + alignment - 1) / alignment * alignment;
+    if (chunk_used_ + size > chunk_size_) {
+      chunk_size_ = std::max(std::min(2 * chunk_size_, kMaxChunkSize), std::max(kMinChunkSize, size));
+      chunks_.push_back(std::make_unique<std::byte[]>(chunk_size_));
+      chunk_used_ = 0;
+    }
+    auto memory = chunks_.back().get() + chunk_used_;
+    chunk_used_ += size;
+    return memory;
+  }
+
+  Regex Regex::Parse(const std::string &input, std::shared_ptr<NodeStore> store) {
+    automata::TraceSpan span("Parse");
     using Token = std::variant<Regex, char>;
     std::vector<Token> stack;
     auto reduce_sum = [&stack]() {
@@ -97,11 +144,11 @@ namespace regex {
       if (symbol == '(') {
         stack.emplace_back(symbol);
       } else if (symbol == '0') {
-        stack.emplace_back(Create<None>());
+        stack.emplace_back(Regex(store, store->Create<None>()));
       } else if (symbol == '1') {
-        stack.emplace_back(Create<Empty>());
+        stack.emplace_back(Regex(store, store->Create<Empty>()));
       } else {
-        stack.emplace_back(Create<Literal>(symbol));
+        stack.emplace_back(Regex(store, store->Create<Literal>(symbol)));
       }
     }
     if (stack.size() != 1) {
@@ -110,13 +157,14 @@ namespace regex {
     return std::get<Regex>(stack[0]);
   }
 
-  Regex Regex::ParseReversePolish(const std::string &input) {
+  Regex Regex::ParseReversePolish(const std::string &input, std::shared_ptr<NodeStore> store) {
+    automata::TraceSpan span("ParseReversePolish");
     std::vector<Regex> stack;
     for (char symbol : input) {
       if (symbol == '0') {
-        stack.emplace_back(Create<None>());
+        stack.emplace_back(store, store->Create<None>());
       } else if (symbol == '1') {
-        stack.emplace_back(Create<Empty>());
+        stack.emplace_back(store, store->Create<Empty>());
       } else if (symbol == '*') {
         if (stack.empty()) {
           throw InvalidInputException("No argument for *");
@@ -135,7 +183,7 @@ namespace regex {
         stack[stack.size() - 2] = stack[stack.size() - 2] * stack.back();
         stack.pop_back();
       } else {
-        stack.emplace_back(regex::Create<Literal>(symbol));
+        stack.emplace_back(store, store->Create<Literal>(symbol));
       }
     }
     if (stack.size() != 1) {
@@ -156,25 +204,61 @@ namespace regex {
     return os;
   }
 
-  template<>
-  Regex Create<Empty>() {
-    static auto regex = Regex(std::make_shared<Empty>());
-    return regex;
+  Regex::Regex() : Regex(Create<Empty>()) {}
+
+  namespace {
+    // Compares nodes of different stores by structure; pairs found equal are remembered, so shared
+    // subexpressions are compared once.
+    bool AreIdentical(RegexPtr first, RegexPtr second, std::set<std::pair<RegexPtr, RegexPtr>> &equal_pairs) {
+      if (first == second) {
+        return true;
+      }
+      if (first->hash() != second->hash() || !first->IsSameData(*second)) {
+        return false;
+      }
+      if (equal_pairs.contains({first, second})) {
+        return true;
+      }
+      auto first_children = first->children();
+      auto second_children = second->children();
+      for (std::size_t i = 0; i < first_children.size(); ++i) {
+        if (!AreIdentical(first_children[i], second_children[i], equal_pairs)) {
+          return false;
+        }
+      }
+      equal_pairs.emplace(first, second);
+      return true;
+    }
+
+    // Operands of different stores are combined in the store with more nodes, so that the new node imports the
+    // smaller side rather than copying a large expression into a small store.
+    const std::shared_ptr<NodeStore> &GetCommonStore(const Regex &first, const Regex &second) {
+      if (first.shared_store() == second.shared_store() ||
+          first.store().GetNodeNumber() >= second.store().GetNodeNumber()) {
+        return first.shared_store();
+      }
+      return second.shared_store();
+    }
   }
 
-  template<>
-  Regex Create<None>() {
-    static auto regex = Regex(std::make_shared<None>());
-    return regex;
+  Regex Regex::ImportTo(std::shared_ptr<NodeStore> store) const {
+    auto root_node = store->Import(root_node_);
+    return {std::move(store), root_node};
   }
 
-  Regex::Regex() : Regex(Create<Empty>()) {}
+  bool Regex::IsIdentical(const Regex &other) const {
+    if (store_ == other.store_) {
+      return root_node_ == other.root_node_;
+    }
+    std::set<std::pair<RegexPtr, RegexPtr>> equal_pairs;
+    return AreIdentical(root_node_, other.root_node_, equal_pairs);
+  }
 
   Regex regex::Regex::Iterate() {
     if (root_node_->IsNone() || root_node_->IsEmpty()) {
-      return Create<Empty>();
+      return {store_, store_->Create<Empty>()};
     }
-    return Create<KleeneStar>(root_node_);
+    return {store_, store_->Create<KleeneStar>(root_node_)};
   }
 
   Regex regex::Regex::operator+(const Regex &other) const {
@@ -184,7 +268,8 @@ namespace regex {
     if (root_node_->IsNone()) {
       return other;
     }
-    return Create<Alteration>(root_node_, other.root_node_);
+    const auto &store = GetCommonStore(*this, other);
+    return {store, store->Create<Alteration>(root_node_, other.root_node_)};
   }
 
   Regex &regex::Regex::operator+=(const Regex &other) {
@@ -198,7 +283,8 @@ namespace regex {
     if (other.root_node_->IsNone() || root_node_->IsEmpty()) {
       return other;
     }
-    return Create<Concatenation>(root_node_, other.root_node_);
+    const auto &store = GetCommonStore(*this, other);
+    return {store, store->Create<Concatenation>(root_node_, other.root_node_)};
   }
 
   Regex &regex::Regex::operator*=(const Regex &other) {
@@ -206,6 +292,414 @@ namespace regex {
   }
 
   bool regex::Regex::operator==(const Regex &other) const {
-    return automata::RegexToMCDFA(*this, {}).IsEquivalent(automata::RegexToMCDFA(other, {}));
+    auto automaton = automata::NondeterministicAutomaton::FromRegex(*this, automata::RegexConstruction::kGlushkov);
+    return automaton.IsEquivalent(
+        automata::NondeterministicAutomaton::FromRegex(other, automata::RegexConstruction::kGlushkov));
+  }
+
+  namespace {
+    template<typename T>
+    const T *As(RegexPtr node) {
+      return node->kind() == T::kKind ? static_cast<const T *>(node) : nullptr;
+    }
+
+    template<typename T>
+    void Flatten(RegexPtr node, std::vector<RegexPtr> &parts) {
+      if (auto composite = As<T>(node)) {
+        Flatten<T>(composite->children_[0], parts);
+        Flatten<T>(composite->children_[1], parts);
+      } else {
+        parts.push_back(node);
+      }
+    }
+
+    template<typename T>
+    std::vector<RegexPtr> Flatten(RegexPtr node) {
+      std::vector<RegexPtr> parts;
+      Flatten<T>(node, parts);
+      return parts;
+    }
+
+    template<typename T>
+    RegexPtr Fold(NodeStore &store, const std::vector<RegexPtr> &parts) {
+      auto result = parts[0];
+      for (std::size_t i = 1; i < parts.size(); ++i) {
+        result = store.Create<T>(result, parts[i]);
+      }
+      return result;
+    }
+
+    std::size_t GetRank(RegexPtr node) {
+      if (node->IsNone()) {
+        return 0;
+      }
+      if (node->IsEmpty()) {
+        return 1;
+      }
+      if (As<Literal>(node)) {
+        return 2;
+      }
+      if (As<KleeneStar>(node)) {
+        return 3;
+      }
+      if (As<Concatenation>(node)) {
+        return 4;
+      }
+      return 5;
+    }
+
+    // Whether L(inner) is a subset of L(outer*), judged by the alternatives of both.
+    bool IsAbsorbedByStar(RegexPtr inner, RegexPtr outer) {
+      if (inner == outer) {
+        return true;
+      }
+      auto outer_terms = Flatten<Alteration>(outer);
+      return std::ranges::all_of(Flatten<Alteration>(inner), [&outer_terms](auto term) {
+        return std::ranges::find(outer_terms, term) != outer_terms.end();
+      });
+    }
+  }
+
+  Regex Regex::Simplify() const {
+    return Simplifier().Simplify(*this);
+  }
+
+  Regex Simplifier::Simplify(const Regex &expression) {
+    return {store_, SimplifyNode(store_->Import(&expression.root()))};
+  }
+
+  Regex Simplifier::Add(const Regex &first, const Regex &second) {
+    auto terms = Flatten<Alteration>(store_->Import(&first.root()));
+    Flatten<Alteration>(store_->Import(&second.root()), terms);
+    return {store_, Alternate(std::move(terms))};
+  }
+
+  Regex Simplifier::Multiply(const Regex &first, const Regex &second) {
+    auto factors = Flatten<Concatenation>(store_->Import(&first.root()));
+    Flatten<Concatenation>(store_->Import(&second.root()), factors);
+    return {store_, Concatenate(std::move(factors))};
+  }
+
+  Regex Simplifier::Iterate(const Regex &inner) {
+    return {store_, IterateNode(store_->Import(&inner.root()))};
+  }
+
+  RegexPtr Simplifier::SimplifyNode(RegexPtr node) {
+    auto it = simplified_.find(node);
+    if (it != simplified_.end()) {
+      return it->second;
+    }
+    RegexPtr result = node;
+    if (As<Alteration>(node)) {
+      auto terms = Flatten<Alteration>(node);
+      for (auto &term: terms) {
+        term = SimplifyNode(term);
+      }
+      result = Alternate(std::move(terms));
+    } else if (As<Concatenation>(node)) {
+      auto factors = Flatten<Concatenation>(node);
+      for (auto &factor: factors) {
+        factor = SimplifyNode(factor);
+      }
+      result = Concatenate(std::move(factors));
+    } else if (As<KleeneStar>(node)) {
+      result = IterateNode(SimplifyNode(node->children()[0]));
+    }
+    simplified_[node] = result;
+    return result;
+  }
+
+  RegexPtr Simplifier::Alternate(std::vector<RegexPtr> terms) {
+    {
+      std::vector<RegexPtr> flat_terms;
+      for (auto term: terms) {
+        Flatten<Alteration>(term, flat_terms);
+      }
+      terms = std::move(flat_terms);
+    }
+    std::erase_if(terms, [](auto term) { return term->IsNone(); });
+    auto sort_terms = [this, &terms]() {
+      std::ranges::sort(terms, [this](auto first, auto second) { return IsLess(first, second); });
+      terms.erase(std::ranges::unique(terms).begin(), terms.end());
+    };
+    sort_terms();
+
+    // x + x* = x*, and 1 + x = x for nullable x.
+    std::vector<RegexPtr> stars;
+    std::ranges::copy_if(terms, std::back_inserter(stars), [](auto term) { return As<KleeneStar>(term); });
+    std::erase_if(terms, [&stars](auto term) {
+      return std::ranges::any_of(stars, [term](auto star) {
+        return term != star && IsAbsorbedByStar(term, star->children()[0]);
+      });
+    });
+    auto empty = std::ranges::find_if(terms, [](auto term) { return term->IsEmpty(); });
+    if (empty != terms.end()) {
+      // 1 + xx* = 1 + x*x = x*
+      for (auto &term: terms) {
+        auto factors = Flatten<Concatenation>(term);
+        if (factors.size() == 2) {
+          auto star = As<KleeneStar>(factors[1]) ? factors[1] : factors[0];
+          auto other = star == factors[1] ? factors[0] : factors[1];
+          if (As<KleeneStar>(star) && star->children()[0] == other) {
+            term = star;
+          }
+        }
+      }
+      if (std::ranges::count_if(terms, [this](auto term) { return !term->IsEmpty() && IsNullable(term); }) > 0) {
+        std::erase_if(terms, [](auto term) { return term->IsEmpty(); });
+      }
+      sort_terms();
+    }
+
+    if (terms.size() > 1) {
+      terms = FactorOut(std::move(terms), true);
+      terms = FactorOut(std::move(terms), false);
+      sort_terms();
+    }
+    if (terms.empty()) {
+      return store_->Create<None>();
+    }
+    return Fold<Alteration>(*store_, terms);
+  }
+
+  std::vector<RegexPtr> Simplifier::FactorOut(std::vector<RegexPtr> terms, bool prefixes) {
+    std::vector<RegexPtr> result;
+    std::vector<bool> is_used(terms.size());
+    for (std::size_t i = 0; i < terms.size(); ++i) {
+      if (is_used[i]) {
+        continue;
+      }
+      auto factors = Flatten<Concatenation>(terms[i]);
+      auto common = prefixes ? factors.front() : factors.back();
+      std::vector<std::size_t> group{i};
+      for (std::size_t j = i + 1; j < terms.size(); ++j) {
+        auto other_factors = Flatten<Concatenation>(terms[j]);
+        if (!is_used[j] && (prefixes ? other_factors.front() : other_factors.back()) == common) {
+          group.push_back(j);
+        }
+      }
+      if (group.size() == 1) {
+        result.push_back(terms[i]);
+        continue;
+      }
+      std::vector<RegexPtr> rests;
+      std::size_t old_size = group.size() - 1;
+      for (auto j: group) {
+        auto rest = Flatten<Concatenation>(terms[j]);
+        old_size += GetSize(terms[j]);
+        if (prefixes) {
+          rest.erase(rest.begin());
+        } else {
+          rest.pop_back();
+        }
+        rests.push_back(Concatenate(std::move(rest)));
+      }
+      auto alternatives = Alternate(std::move(rests));
+      auto factored = prefixes ? Concatenate({common, alternatives}) : Concatenate({alternatives, common});
+      if (GetSize(factored) < old_size) {
+        result.push_back(factored);
+        for (auto j: group) {
+          is_used[j] = true;
+        }
+      } else {
+        result.push_back(terms[i]);
+      }
+    }
+    return result;
+  }
+
+  RegexPtr Simplifier::Concatenate(std::vector<RegexPtr> factors) {
+    std::vector<RegexPtr> result;
+    for (auto factor: factors) {
+      if (factor->IsNone()) {
+        return factor;
+      }
+      if (factor->IsEmpty()) {
+        continue;
+      }
+      Flatten<Concatenation>(factor, result);
+      // x*y* = y* if x is contained in y*, and symmetrically.
+      while (result.size() >= 2 && As<KleeneStar>(result.back()) && As<KleeneStar>(result[result.size() - 2])) {
+        auto last = result.back()->children()[0];
+        auto previous = result[result.size() - 2]->children()[0];
+        if (IsAbsorbedByStar(previous, last)) {
+          result.erase(result.end() - 2);
+        } else if (IsAbsorbedByStar(last, previous)) {
+          result.pop_back();
+        } else {
+          break;
+        }
+      }
+    }
+    if (result.empty()) {
+      return store_->Create<Empty>();
+    }
+    return Fold<Concatenation>(*store_, result);
+  }
+
+  RegexPtr Simplifier::IterateNode(RegexPtr inner) {
+    if (inner->IsNone() || inner->IsEmpty()) {
+      return store_->Create<Empty>();
+    }
+    if (As<KleeneStar>(inner)) {
+      return inner;
+    }
+    // Under a star, (1 + x*y* + z*)* = (x + y + z)*.
+    bool is_changed = false;
+    std::vector<RegexPtr> terms;
+    for (auto term: Flatten<Alteration>(inner)) {
+      auto factors = Flatten<Concatenation>(term);
+      if (term->IsEmpty()) {
+        is_changed = true;
+      } else if (std::ranges::all_of(factors, [](auto factor) { return As<KleeneStar>(factor); })) {
+        for (auto factor: factors) {
+          terms.push_back(factor->children()[0]);
+        }
+        is_changed = true;
+      } else {
+        terms.push_back(term);
+      }
+    }
+    if (is_changed) {
+      inner = Alternate(std::move(terms));
+      if (inner->IsNone() || inner->IsEmpty()) {
+        return store_->Create<Empty>();
+      }
+      if (As<KleeneStar>(inner)) {
+        return inner;
+      }
+    }
+    return store_->Create<KleeneStar>(inner);
+  }
+
+  bool Simplifier::IsLess(RegexPtr first, RegexPtr second) {
+    if (first == second) {
+      return false;
+    }
+    if (GetSize(first) != GetSize(second)) {
+      return GetSize(first) < GetSize(second);
+    }
+    if (GetRank(first) != GetRank(second)) {
+      return GetRank(first) < GetRank(second);
+    }
+    if (auto first_literal = As<Literal>(first)) {
+      return static_cast<unsigned char>(first_literal->symbol) <
+             static_cast<unsigned char>(As<Literal>(second)->symbol);
+    }
+    auto first_children = first->children();
+    auto second_children = second->children();
+    for (std::size_t i = 0; i < first_children.size(); ++i) {
+      if (first_children[i] != second_children[i]) {
+        return IsLess(first_children[i], second_children[i]);
+      }
+    }
+    return false;
+  }
+
+  bool Simplifier::IsNullable(RegexPtr node) {
+    auto it = is_nullable_.find(node);
+    if (it != is_nullable_.end()) {
+      return it->second;
+    }
+    bool is_nullable;
+    if (node->IsEmpty() || As<KleeneStar>(node)) {
+      is_nullable = true;
+    } else if (As<Concatenation>(node)) {
+      is_nullable = IsNullable(node->children()[0]) && IsNullable(node->children()[1]);
+    } else if (As<Alteration>(node)) {
+      is_nullable = IsNullable(node->children()[0]) || IsNullable(node->children()[1]);
+    } else {
+      is_nullable = false;
+    }
+    return is_nullable_[node] = is_nullable;
+  }
+
+  std::size_t Simplifier::GetSize(RegexPtr node) {
+    auto it = size_.find(node);
+    if (it != size_.end()) {
+      return it->second;
+    }
+    std::size_t size = 1;
+    for (auto child: node->children()) {
+      size = std::min(size + GetSize(child), std::numeric_limits<std::size_t>::max() / 2);
+    }
+    return size_[node] = size;
+  }
+
+  Regex DerivativeBuilder::GetDerivative(const Regex &expression, char symbol) {
+    return {store_, GetDerivative(store_->Import(&expression.root()), symbol)};
+  }
+
+  bool DerivativeBuilder::IsNullable(const Regex &expression) {
+    return IsNullable(store_->Import(&expression.root()));
+  }
+
+  RegexPtr DerivativeBuilder::GetDerivative(RegexPtr node, char symbol) {
+    auto it = derivatives_.find({node, symbol});
+    if (it != derivatives_.end()) {
+      return it->second;
+    }
+    RegexPtr derivative;
+    if (auto literal = As<Literal>(node)) {
+      derivative = literal->symbol == symbol ? store_->Create<Empty>() : store_->Create<None>();
+    } else if (As<Alteration>(node)) {
+      derivative = Unite(GetDerivative(node->children()[0], symbol), GetDerivative(node->children()[1], symbol));
+    } else if (As<Concatenation>(node)) {
+      derivative = Concatenate(GetDerivative(node->children()[0], symbol), node->children()[1]);
+      if (IsNullable(node->children()[0])) {
+        derivative = Unite(derivative, GetDerivative(node->children()[1], symbol));
+      }
+    } else if (As<KleeneStar>(node)) {
+      derivative = Concatenate(GetDerivative(node->children()[0], symbol), node);
+    } else {
+      derivative = store_->Create<None>();
+    }
+    derivatives_[{node, symbol}] = derivative;
+    return derivative;
+  }
+
+  bool DerivativeBuilder::IsNullable(RegexPtr node) {
+    auto it = is_nullable_.find(node);
+    if (it != is_nullable_.end()) {
+      return it->second;
+    }
+    bool is_nullable;
+    if (node->IsEmpty() || As<KleeneStar>(node)) {
+      is_nullable = true;
+    } else if (As<Concatenation>(node)) {
+      is_nullable = IsNullable(node->children()[0]) && IsNullable(node->children()[1]);
+    } else if (As<Alteration>(node)) {
+      is_nullable = IsNullable(node->children()[0]) || IsNullable(node->children()[1]);
+    } else {
+      is_nullable = false;
+    }
+    return is_nullable_[node] = is_nullable;
+  }
+
+  RegexPtr DerivativeBuilder::Unite(RegexPtr first, RegexPtr second) {
+    if (first->IsNone() || first == second) {
+      return second;
+    }
+    if (second->IsNone()) {
+      return first;
+    }
+    auto terms = Flatten<Alteration>(first);
+    Flatten<Alteration>(second, terms);
+    std::ranges::sort(terms, [](auto first_term, auto second_term) {
+      return first_term->hash() != second_term->hash() ? first_term->hash() < second_term->hash()
+                                                       : std::less<RegexPtr>()(first_term, second_term);
+    });
+    terms.erase(std::ranges::unique(terms).begin(), terms.end());
+    return Fold<Alteration>(*store_, terms);
+  }
+
+  RegexPtr DerivativeBuilder::Concatenate(RegexPtr first, RegexPtr second) {
+    if (first->IsNone() || second->IsEmpty()) {
+      return first;
+    }
+    if (second->IsNone() || first->IsEmpty()) {
+      return second;
+    }
+    return store_->Create<Concatenation>(first, second);
   }
 }
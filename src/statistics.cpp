@@ -0,0 +1,42 @@
+#include "statistics.h"
+
+namespace automata {
+  std::string_view GetCounterName(Counter counter) {
+    switch (counter) {
+      case Counter::kSubsetsCreated:
+        return "subsets_created";
+      case Counter::kSubsetHashHits:
+        return "subset_hash_hits";
+      case Counter::kMinimizationRounds:
+        return "minimization_rounds";
+      case Counter::kMinimizationBlocks:
+        return "minimization_blocks";
+      case Counter::kEmptyTransitionsRemoved:
+        return "empty_transitions_removed";
+      case Counter::kProductTuples:
+        return "product_tuples";
+      case Counter::kPrefixQueuePushes:
+        return "prefix_queue_pushes";
+      default:
+        return "unknown";
+    }
+  }
+
+  Statistics GetStatistics() {
+    Statistics statistics;
+#ifndef AUTOMATA_DISABLE_STATISTICS
+    for (std::size_t i = 0; i < kCounterNumber; ++i) {
+      statistics[static_cast<Counter>(i)] = global_counters[i].load(std::memory_order_relaxed);
+    }
+#endif
+    return statistics;
+  }
+
+  void ResetStatistics() {
+#ifndef AUTOMATA_DISABLE_STATISTICS
+    for (auto &counter: global_counters) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+#endif
+  }
+}
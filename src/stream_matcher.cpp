@@ -0,0 +1,31 @@
+#include "stream_matcher.h"
+#include <algorithm>
+
+namespace automata {
+  namespace {
+    // Long chunks are run in blocks of this size, and the dead state is checked between the blocks.
+    constexpr std::size_t kBlockSize = 4096;
+  }
+
+  StreamMatcher::StreamMatcher(std::shared_ptr<const CompiledDfa> dfa) : dfa_(std::move(dfa)) {
+    if (!dfa_) {
+      throw BadAutomatonException("No automaton to match against");
+    }
+    Reset();
+  }
+
+  bool StreamMatcher::Feed(std::string_view chunk) {
+    while (!chunk.empty() && !IsDead()) {
+      auto block = chunk.substr(0, kBlockSize);
+      state_ = dfa_->Run(state_, block);
+      consumed_byte_number_ += block.size();
+      chunk.remove_prefix(block.size());
+    }
+    return !IsDead();
+  }
+
+  void StreamMatcher::Reset() {
+    state_ = dfa_->initial_state();
+    consumed_byte_number_ = 0;
+  }
+}
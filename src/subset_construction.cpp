@@ -0,0 +1,391 @@
+#include "subset_construction.h"
+#include "parallel.h"
+#include "statistics.h"
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace automata {
+  using Word = SubsetTable::Word;
+
+  namespace {
+    constexpr std::size_t kInitialSlotNumber = 1 << 10;
+  }
+
+  SubsetTable::SubsetTable(std::size_t state_number) :
+      word_number_(GetWordNumberFor(state_number)), slots_(kInitialSlotNumber) {}
+
+  std::uint64_t SubsetTable::GetHash(const Word *subset, std::size_t word_number) {
+    std::uint64_t hash = 0x9e3779b97f4a7c15;
+    for (std::size_t word = 0; word < word_number; ++word) {
+      hash = (hash ^ subset[word]) * 0xff51afd7ed558ccd;
+      hash ^= hash >> 32;
+    }
+    return hash;
+  }
+
+  std::pair<std::size_t, bool> SubsetTable::Insert(const Word *subset, std::uint64_t hash) {
+    auto mask = slots_.size() - 1;
+    auto slot = hash & mask;
+    for (; slots_[slot]; slot = (slot + 1) & mask) {
+      auto index = slots_[slot] - 1;
+      if (hashes_[index] == hash && std::equal(subset, subset + word_number_, GetSubset(index))) {
+        return {index, false};
+      }
+    }
+    auto index = GetSubsetNumber();
+    slots_[slot] = index + 1;
+    hashes_.push_back(hash);
+    words_.insert(words_.end(), subset, subset + word_number_);
+    if (2 * GetSubsetNumber() > slots_.size()) {
+      Grow();
+    }
+    return {index, true};
+  }
+
+  void SubsetTable::Grow() {
+    std::vector<std::size_t> slots(2 * slots_.size());
+    auto mask = slots.size() - 1;
+    for (std::size_t index = 0; index < GetSubsetNumber(); ++index) {
+      auto slot = hashes_[index] & mask;
+      while (slots[slot]) {
+        slot = (slot + 1) & mask;
+      }
+      slots[slot] = index + 1;
+    }
+    slots_ = std::move(slots);
+  }
+
+  struct SubsetConstruction::SuccessorBuffers {
+    explicit SuccessorBuffers(std::size_t word_number) : word_number(word_number) {
+      slot_indices.fill(-1);
+    }
+
+    std::size_t word_number;
+    // Successor set of symbols_in_order[i] is at successors[i * word_number], slot_indices maps symbols to i.
+    std::array<int, 256> slot_indices;
+    std::vector<unsigned char> symbols_in_order;
+    std::vector<Word> successors;
+  };
+
+  namespace {
+    constexpr std::size_t kShardBits = 6;
+
+    constexpr std::size_t kShardNumber = 1 << kShardBits;
+
+    // SubsetTable split into shards by the high bits of the hash, each behind its own mutex. The id of a subset
+    // is its index in the shard times kShardNumber plus the index of the shard.
+    class ConcurrentSubsetTable {
+    public:
+      explicit ConcurrentSubsetTable(std::size_t state_number) {
+        for (std::size_t shard = 0; shard < kShardNumber; ++shard) {
+          shards_.push_back(std::make_unique<Shard>(state_number));
+        }
+      }
+
+      std::pair<std::size_t, bool> Insert(const Word *subset, std::uint64_t hash) {
+        auto shard_index = hash >> (64 - kShardBits);
+        auto &shard = *shards_[shard_index];
+        std::lock_guard lock(shard.mutex);
+        auto [index, inserted] = shard.table.Insert(subset, hash);
+        return {index * kShardNumber + shard_index, inserted};
+      }
+
+      void CopySubset(std::size_t id, Word *subset) {
+        auto &shard = *shards_[id % kShardNumber];
+        std::lock_guard lock(shard.mutex);
+        auto words = shard.table.GetSubset(id / kShardNumber);
+        std::copy(words, words + shard.table.GetWordNumber(), subset);
+      }
+
+      // Returns numbers from 0 to the number of subsets - 1 for the ids once all subsets are added.
+      std::vector<std::size_t> GetDenseNumbers(const std::vector<std::size_t> &ids) const {
+        std::array<std::size_t, kShardNumber + 1> offsets{};
+        for (std::size_t shard = 0; shard < kShardNumber; ++shard) {
+          offsets[shard + 1] = offsets[shard] + shards_[shard]->table.GetSubsetNumber();
+        }
+        std::vector<std::size_t> numbers;
+        numbers.reserve(ids.size());
+        for (auto id: ids) {
+          numbers.push_back(offsets[id % kShardNumber] + id / kShardNumber);
+        }
+        return numbers;
+      }
+
+    private:
+      struct Shard {
+        explicit Shard(std::size_t state_number) : table(state_number) {}
+
+        std::mutex mutex;
+        SubsetTable table;
+      };
+
+      std::vector<std::unique_ptr<Shard>> shards_;
+    };
+
+    // Subset ids to expand: the owner works at the back, and other workers steal from the front. Every
+    // operation takes the lock, which costs little next to expanding a subset.
+    class LockedWorkDeque {
+    public:
+      void Push(std::size_t id) {
+        std::lock_guard lock(mutex_);
+        ids_.push_back(id);
+      }
+
+      std::optional<std::size_t> Pop() {
+        std::lock_guard lock(mutex_);
+        if (ids_.empty()) {
+          return std::nullopt;
+        }
+        auto id = ids_.back();
+        ids_.pop_back();
+        return id;
+      }
+
+      std::optional<std::size_t> Steal() {
+        std::lock_guard lock(mutex_);
+        if (ids_.empty()) {
+          return std::nullopt;
+        }
+        auto id = ids_.front();
+        ids_.pop_front();
+        return id;
+      }
+
+    private:
+      std::mutex mutex_;
+      std::deque<std::size_t> ids_;
+    };
+
+    // Subsets expanded by a worker. Transitions of the i-th subset are symbols[j] -> to_ids[j] for j in
+    // [transition_offsets[i], transition_offsets[i + 1]), in the order they were found, and its accepting
+    // states are accepting_states[j] for j in [accepting_offsets[i], accepting_offsets[i + 1]).
+    struct WorkerBuffer {
+      std::vector<std::size_t> ids;
+      std::vector<std::size_t> accepting_offsets{0};
+      std::vector<std::size_t> accepting_states;
+      std::vector<std::size_t> transition_offsets{0};
+      std::vector<char> symbols;
+      std::vector<std::size_t> to_ids;
+    };
+  }
+
+  SubsetConstruction::SubsetConstruction(const NondeterministicAutomaton &automaton) :
+      state_number_(automaton.GetStateNumber()), initial_state_(automaton.initial_state()),
+      is_accepting_(automaton.is_accepting()), offsets_{0} {
+    for (std::size_t state = 0; state < state_number_; ++state) {
+      for (const auto &transition: automaton.GetTransitions(state)) {
+        if (transition.symbol.size() != 1) {
+          throw BadAutomatonException("Transition is not single-letter");
+        }
+        symbols_.push_back(transition.symbol[0]);
+        to_states_.push_back(transition.to_state);
+      }
+      offsets_.push_back(symbols_.size());
+    }
+  }
+
+  template<typename F>
+  void SubsetConstruction::Expand(const Word *subset, SuccessorBuffers &buffers,
+                                  std::vector<std::size_t> &accepting_states, F &&function) const {
+    auto word_number = buffers.word_number;
+    SubsetTable::ForEachState(subset, word_number, [&](std::size_t state) {
+      if (is_accepting_[state]) {
+        accepting_states.push_back(state);
+      }
+      for (auto i = offsets_[state]; i < offsets_[state + 1]; ++i) {
+        auto &slot_index = buffers.slot_indices[symbols_[i]];
+        if (slot_index < 0) {
+          slot_index = static_cast<int>(buffers.symbols_in_order.size());
+          buffers.symbols_in_order.push_back(symbols_[i]);
+          if (buffers.successors.size() < buffers.symbols_in_order.size() * word_number) {
+            buffers.successors.resize(buffers.symbols_in_order.size() * word_number);
+          }
+        }
+        SubsetTable::AddState(&buffers.successors[slot_index * word_number], to_states_[i]);
+      }
+    });
+
+    // The subset may be moved by the function, so it is not read past this point.
+    for (auto slot_index = buffers.symbols_in_order.size(); slot_index-- > 0;) {
+      auto to_subset = &buffers.successors[slot_index * word_number];
+      function(static_cast<char>(buffers.symbols_in_order[slot_index]), static_cast<const Word *>(to_subset));
+      std::fill(to_subset, to_subset + word_number, 0);
+      buffers.slot_indices[buffers.symbols_in_order[slot_index]] = -1;
+    }
+    buffers.symbols_in_order.clear();
+  }
+
+  DeterministicAutomaton SubsetConstruction::Determinize(std::size_t thread_number) const {
+    std::vector<std::vector<std::size_t>> accepting_states;
+    return Determinize(thread_number, accepting_states);
+  }
+
+  DeterministicAutomaton
+  SubsetConstruction::Determinize(std::size_t thread_number,
+                                  std::vector<std::vector<std::size_t>> &accepting_states) const {
+    TraceSpan span("SubsetConstruction");
+    if (thread_number > 1) {
+      return DeterminizeInParallel(thread_number, accepting_states);
+    }
+    SubsetTable table(state_number_);
+    auto word_number = table.GetWordNumber();
+    std::vector<Word> initial_subset(word_number);
+    SubsetTable::AddState(initial_subset.data(), initial_state_);
+    table.Insert(initial_subset.data(), SubsetTable::GetHash(initial_subset.data(), word_number));
+    std::vector<std::size_t> to_process{0};
+    DeterministicAutomaton determinized_automaton{1, 0};
+    accepting_states.assign(1, {});
+
+    SuccessorBuffers buffers(word_number);
+    std::vector<std::size_t> subset_accepting_states;
+    std::uint64_t hit_number = 0;
+    while (!to_process.empty()) {
+      auto subset_index = to_process.back();
+      to_process.pop_back();
+      subset_accepting_states.clear();
+      Expand(table.GetSubset(subset_index), buffers, subset_accepting_states, [&](char symbol, const Word *to_subset) {
+        auto [to_subset_index, inserted] = table.Insert(to_subset, SubsetTable::GetHash(to_subset, word_number));
+        if (inserted) {
+          determinized_automaton.AddState();
+          accepting_states.emplace_back();
+          to_process.push_back(to_subset_index);
+        } else {
+          ++hit_number;
+        }
+        determinized_automaton.AddTransition(subset_index, to_subset_index, symbol);
+      });
+      determinized_automaton.SetAccepting(subset_index, !subset_accepting_states.empty());
+      accepting_states[subset_index] = subset_accepting_states;
+    }
+    CountEvent(Counter::kSubsetsCreated, table.GetSubsetNumber());
+    CountEvent(Counter::kSubsetHashHits, hit_number);
+    return determinized_automaton;
+  }
+
+  DeterministicAutomaton
+  SubsetConstruction::DeterminizeInParallel(std::size_t thread_number,
+                                            std::vector<std::vector<std::size_t>> &accepting_states) const {
+    ConcurrentSubsetTable table(state_number_);
+    auto word_number = SubsetTable::GetWordNumberFor(state_number_);
+    std::vector<Word> initial_subset(word_number);
+    SubsetTable::AddState(initial_subset.data(), initial_state_);
+    auto initial_id = table.Insert(initial_subset.data(),
+                                   SubsetTable::GetHash(initial_subset.data(), word_number)).first;
+
+    std::vector<LockedWorkDeque> deques(thread_number);
+    std::vector<WorkerBuffer> worker_buffers(thread_number);
+    // Subsets added but not expanded yet; the workers stop when it drops to 0.
+    std::atomic<std::size_t> pending_number = 1;
+    // Changes whenever a subset is queued or the last one is expanded. Idle workers wait for it to change, and
+    // are only notified while some of them are idle.
+    std::atomic<std::size_t> work_version = 0;
+    std::atomic<std::size_t> idle_number = 0;
+    auto signal_work = [&work_version, &idle_number](bool is_finished) {
+      work_version.fetch_add(1);
+      if (idle_number.load() > 0) {
+        if (is_finished) {
+          work_version.notify_all();
+        } else {
+          work_version.notify_one();
+        }
+      }
+    };
+    deques[0].Push(initial_id);
+    ParallelFor(thread_number, thread_number, [&](std::size_t, std::size_t, std::size_t worker) {
+      SuccessorBuffers buffers(word_number);
+      std::vector<Word> subset(word_number);
+      auto &worker_buffer = worker_buffers[worker];
+      std::uint64_t hit_number = 0;
+      auto take = [&deques, thread_number, worker]() {
+        auto id = deques[worker].Pop();
+        for (std::size_t i = 1; !id && i < thread_number; ++i) {
+          id = deques[(worker + i) % thread_number].Steal();
+        }
+        return id;
+      };
+      while (pending_number.load() > 0) {
+        auto id = take();
+        if (!id) {
+          // The version is read before looking again, so work queued after the look changes it.
+          idle_number.fetch_add(1);
+          auto version = work_version.load();
+          id = take();
+          if (!id && pending_number.load() > 0) {
+            work_version.wait(version);
+          }
+          idle_number.fetch_sub(1);
+          if (!id) {
+            continue;
+          }
+        }
+        table.CopySubset(*id, subset.data());
+        Expand(subset.data(), buffers, worker_buffer.accepting_states, [&](char symbol, const Word *to_subset) {
+          auto [to_id, inserted] = table.Insert(to_subset, SubsetTable::GetHash(to_subset, word_number));
+          if (inserted) {
+            pending_number.fetch_add(1);
+            deques[worker].Push(to_id);
+            signal_work(false);
+          } else {
+            ++hit_number;
+          }
+          worker_buffer.symbols.push_back(symbol);
+          worker_buffer.to_ids.push_back(to_id);
+        });
+        worker_buffer.ids.push_back(*id);
+        worker_buffer.accepting_offsets.push_back(worker_buffer.accepting_states.size());
+        worker_buffer.transition_offsets.push_back(worker_buffer.symbols.size());
+        if (pending_number.fetch_sub(1) == 1) {
+          signal_work(true);
+        }
+      }
+      CountEvent(Counter::kSubsetHashHits, hit_number);
+    });
+
+    // Where every subset was expanded, by its dense number.
+    std::vector<std::pair<const WorkerBuffer *, std::size_t>> expansions;
+    for (auto &worker_buffer: worker_buffers) {
+      worker_buffer.ids = table.GetDenseNumbers(worker_buffer.ids);
+      worker_buffer.to_ids = table.GetDenseNumbers(worker_buffer.to_ids);
+      expansions.resize(expansions.size() + worker_buffer.ids.size());
+    }
+    CountEvent(Counter::kSubsetsCreated, expansions.size());
+    for (const auto &worker_buffer: worker_buffers) {
+      for (std::size_t i = 0; i < worker_buffer.ids.size(); ++i) {
+        expansions[worker_buffer.ids[i]] = {&worker_buffer, i};
+      }
+    }
+
+    // Replays the sequential construction over the found transitions to number the states the same way.
+    auto initial_number = table.GetDenseNumbers({initial_id})[0];
+    std::vector<std::optional<std::size_t>> states(expansions.size());
+    states[initial_number] = 0;
+    std::vector<std::size_t> to_process{initial_number};
+    DeterministicAutomaton determinized_automaton{1, 0};
+    accepting_states.assign(1, {});
+    while (!to_process.empty()) {
+      auto number = to_process.back();
+      to_process.pop_back();
+      auto [worker_buffer, i] = expansions[number];
+      auto accepting_begin = worker_buffer->accepting_states.begin() + worker_buffer->accepting_offsets[i];
+      auto accepting_end = worker_buffer->accepting_states.begin() + worker_buffer->accepting_offsets[i + 1];
+      determinized_automaton.SetAccepting(*states[number], accepting_begin != accepting_end);
+      accepting_states[*states[number]].assign(accepting_begin, accepting_end);
+      for (auto j = worker_buffer->transition_offsets[i]; j < worker_buffer->transition_offsets[i + 1]; ++j) {
+        auto to_number = worker_buffer->to_ids[j];
+        if (!states[to_number]) {
+          states[to_number] = determinized_automaton.AddState();
+          accepting_states.emplace_back();
+          to_process.push_back(to_number);
+        }
+        determinized_automaton.AddTransition(*states[number], *states[to_number], worker_buffer->symbols[j]);
+      }
+    }
+    return determinized_automaton;
+  }
+}
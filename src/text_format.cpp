@@ -0,0 +1,228 @@
+#include "text_format.h"
+#include <cerrno>
+#include <charconv>
+#include <fstream>
+#include <numeric>
+#include <span>
+#include <system_error>
+
+namespace automata {
+  namespace {
+    // Reads tokens the way Parse does with operator>>: every token may be preceded by any whitespace,
+    // line breaks included, and a number ends at its last digit. Line breaks that Parse reads with
+    // SkipNewline must come right after the last token, with no spaces or carriage returns before them.
+    class TextCursor {
+    public:
+      explicit TextCursor(std::string_view text) : text_(text) {}
+
+      [[noreturn]] void Fail(const std::string &message) const {
+        FailAt(position_, message);
+      }
+
+      [[noreturn]] void FailAtLastToken(const std::string &message) const {
+        FailAt(token_begin_, message);
+      }
+
+      bool IsAtNewline() const {
+        return position_ < text_.size() && text_[position_] == '\n';
+      }
+
+      void ReadNewline() {
+        if (!IsAtNewline()) {
+          Fail("end of line expected");
+        }
+        Advance();
+      }
+
+      std::size_t ReadNumber(const char *expected) {
+        StartToken(expected);
+        auto end = position_;
+        while (end < text_.size() && text_[end] >= '0' && text_[end] <= '9') {
+          ++end;
+        }
+        std::size_t number;
+        auto [number_end, error] = std::from_chars(text_.data() + position_, text_.data() + end, number);
+        if (end == position_) {
+          FailAtLastToken(std::string(expected) + " expected, got \"" + std::string(PeekWord()) + "\"");
+        }
+        if (error != std::errc()) {
+          FailAtLastToken(std::string(expected) + " is too large");
+        }
+        position_ = end;
+        return number;
+      }
+
+      std::size_t ReadState(const char *expected, std::size_t state_number) {
+        auto state = ReadNumber(expected);
+        if (state >= state_number) {
+          FailAtLastToken("state " + std::to_string(state) + " does not exist");
+        }
+        return state;
+      }
+
+      // Reads up to the next whitespace, like operator>> into a string.
+      std::string_view ReadWord(const char *expected) {
+        StartToken(expected);
+        auto word = PeekWord();
+        position_ += word.size();
+        return word;
+      }
+
+      // Reads one character, like operator>> into a char.
+      std::string_view ReadSymbol(const char *expected) {
+        StartToken(expected);
+        auto symbol = text_.substr(position_, 1);
+        Advance();
+        return symbol;
+      }
+
+      bool IsAtWordEnd() const {
+        return position_ == text_.size() || IsWhitespace(text_[position_]);
+      }
+
+    private:
+      [[noreturn]] void FailAt(std::size_t position, const std::string &message) const {
+        throw InvalidInputException("line " + std::to_string(line_) + ", column " +
+                                    std::to_string(position - line_begin_ + 1) + ": " + message);
+      }
+
+      // The whitespace skipped by operator>> in the classic locale.
+      static bool IsWhitespace(char symbol) {
+        return symbol == ' ' || symbol == '\t' || symbol == '\n' || symbol == '\v' || symbol == '\f' ||
+               symbol == '\r';
+      }
+
+      void Advance() {
+        if (text_[position_++] == '\n') {
+          ++line_;
+          line_begin_ = position_;
+        }
+      }
+
+      void StartToken(const char *expected) {
+        while (position_ < text_.size() && IsWhitespace(text_[position_])) {
+          Advance();
+        }
+        if (position_ == text_.size()) {
+          Fail(std::string(expected) + " expected");
+        }
+        token_begin_ = position_;
+      }
+
+      std::string_view PeekWord() const {
+        auto end = position_;
+        while (end < text_.size() && !IsWhitespace(text_[end])) {
+          ++end;
+        }
+        return text_.substr(position_, end - position_);
+      }
+
+      std::string_view text_;
+      std::size_t position_ = 0;
+      std::size_t line_ = 1;
+      std::size_t line_begin_ = 0;
+      std::size_t token_begin_ = 0;
+    };
+
+    // Reads one transition string as a view into the text.
+    template<typename T>
+    std::string_view ReadTransitionString(TextCursor &cursor) {
+      if constexpr (std::is_same_v<typename T::TransitionString, char>) {
+        auto symbol = cursor.ReadSymbol("transition string");
+        if (!cursor.IsAtWordEnd()) {
+          cursor.FailAtLastToken("transition of a deterministic automaton must be a single symbol");
+        }
+        return symbol;
+      } else {
+        return cursor.ReadWord("transition string");
+      }
+    }
+
+    // Like Add, keeps the first of the transitions by the same symbol. Inserting in order of the keys puts
+    // every node at the end of the tree, which is much cheaper than looking for its place.
+    void Fill(TransitionMap &container, std::span<Transition<char>> transitions) {
+      std::ranges::stable_sort(transitions, {}, &Transition<char>::symbol);
+      for (const auto &transition: transitions) {
+        if (container.empty() || std::prev(container.Map::end())->first != transition.symbol) {
+          container.emplace_hint(container.Map::end(), transition.symbol, transition.to_state);
+        }
+      }
+    }
+  }
+
+  template<typename T>
+  T ParseText(std::string_view text) {
+    TextCursor cursor(text);
+    auto state_number = cursor.ReadNumber("number of states");
+    auto initial_state = cursor.ReadState("initial state", std::max<std::size_t>(state_number, 1));
+    cursor.ReadNewline();
+    std::vector<bool> is_accepting(state_number);
+    while (!cursor.IsAtNewline()) {
+      is_accepting[cursor.ReadState("accepting state", state_number)] = true;
+    }
+    cursor.ReadNewline();
+
+    // The first pass checks the transitions and counts them by source state.
+    std::vector<std::size_t> transition_numbers(state_number);
+    auto second_pass = cursor;
+    while (!cursor.IsAtNewline()) {
+      ++transition_numbers[cursor.ReadState("source state", state_number)];
+      cursor.ReadState("target state", state_number);
+      ReadTransitionString<T>(cursor);
+      cursor.ReadNewline();
+    }
+    std::vector<std::remove_cvref_t<decltype(std::declval<T>().GetTransitions(0))>> transitions(state_number);
+    cursor = second_pass;
+    if constexpr (std::is_same_v<typename T::TransitionString, char>) {
+      // Transitions of every state are gathered next to each other before they go to the maps.
+      std::vector<std::size_t> offsets(state_number + 1);
+      std::partial_sum(transition_numbers.begin(), transition_numbers.end(), offsets.begin() + 1);
+      std::vector<Transition<char>> all_transitions(offsets.back(), {'\0', 0});
+      auto next_positions = offsets;
+      while (!cursor.IsAtNewline()) {
+        auto from_state = cursor.ReadNumber("source state");
+        auto to_state = cursor.ReadNumber("target state");
+        all_transitions[next_positions[from_state]++] = {ReadTransitionString<T>(cursor).front(), to_state};
+        cursor.ReadNewline();
+      }
+      for (std::size_t state = 0; state < state_number; ++state) {
+        Fill(transitions[state], std::span(all_transitions).subspan(offsets[state], transition_numbers[state]));
+      }
+    } else {
+      for (std::size_t state = 0; state < state_number; ++state) {
+        transitions[state].reserve(transition_numbers[state]);
+      }
+      while (!cursor.IsAtNewline()) {
+        auto from_state = cursor.ReadNumber("source state");
+        auto to_state = cursor.ReadNumber("target state");
+        transitions[from_state].Add({std::string(ReadTransitionString<T>(cursor)), to_state});
+        cursor.ReadNewline();
+      }
+    }
+    return T(initial_state, std::move(is_accepting), std::move(transitions));
+  }
+
+  template<typename T>
+  T LoadText(const std::string &path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) {
+      throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+    }
+    std::string text;
+    is.seekg(0, std::ios::end);
+    text.resize(static_cast<std::size_t>(is.tellg()));
+    is.seekg(0);
+    if (!is.read(text.data(), static_cast<std::streamsize>(text.size()))) {
+      throw std::system_error(errno, std::generic_category(), "Cannot read " + path);
+    }
+    return ParseText<T>(text);
+  }
+
+  template DeterministicAutomaton ParseText<DeterministicAutomaton>(std::string_view text);
+
+  template NondeterministicAutomaton ParseText<NondeterministicAutomaton>(std::string_view text);
+
+  template DeterministicAutomaton LoadText<DeterministicAutomaton>(const std::string &path);
+
+  template NondeterministicAutomaton LoadText<NondeterministicAutomaton>(const std::string &path);
+}
@@ -0,0 +1,190 @@
+#include "trace.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace automata {
+  namespace {
+    struct TraceEvent {
+      const char *name;
+      std::int64_t begin_ns;
+      std::int64_t duration_ns;
+    };
+
+    // Spans of one thread at a time. Only the owner writes; every slot is guarded by its own sequence number,
+    // odd while the slot is being written, so a reader that finds the same even number before and after copying
+    // a span knows the copy is neither torn nor overwritten by a newer span. Every span is tagged with the
+    // generation current when it was written, and ClearTrace only advances the generation, so clearing never
+    // touches what the owner writes.
+    class TraceBuffer {
+    public:
+      static constexpr std::size_t kCapacity = 1 << 12;
+
+      explicit TraceBuffer(std::size_t thread_index) : thread_index_(thread_index), slots_(kCapacity) {}
+
+      void Add(const TraceEvent &event, std::uint64_t generation) {
+        auto written_number = written_number_.load(std::memory_order_relaxed);
+        auto &slot = slots_[written_number % kCapacity];
+        slot.sequence.store(2 * written_number + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(event.name, std::memory_order_relaxed);
+        slot.begin_ns.store(event.begin_ns, std::memory_order_relaxed);
+        slot.duration_ns.store(event.duration_ns, std::memory_order_relaxed);
+        slot.generation.store(generation, std::memory_order_relaxed);
+        slot.sequence.store(2 * written_number + 2, std::memory_order_release);
+        written_number_.store(written_number + 1, std::memory_order_release);
+      }
+
+      // Visits the spans of the given generation that are not being overwritten meanwhile.
+      template<typename F>
+      void ForEachEvent(std::uint64_t generation, F &&function) const {
+        auto written_number = written_number_.load(std::memory_order_acquire);
+        auto begin = written_number > kCapacity ? written_number - kCapacity : 0;
+        for (auto i = begin; i < written_number; ++i) {
+          const auto &slot = slots_[i % kCapacity];
+          auto sequence = slot.sequence.load(std::memory_order_acquire);
+          if (sequence != 2 * i + 2) {
+            continue;
+          }
+          TraceEvent event{slot.name.load(std::memory_order_relaxed), slot.begin_ns.load(std::memory_order_relaxed),
+                           slot.duration_ns.load(std::memory_order_relaxed)};
+          auto event_generation = slot.generation.load(std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if (slot.sequence.load(std::memory_order_relaxed) == sequence && event_generation == generation) {
+            function(event);
+          }
+        }
+      }
+
+      std::size_t thread_index() const {
+        return thread_index_;
+      }
+
+    private:
+      struct Slot {
+        std::atomic<std::size_t> sequence = 0;
+        std::atomic<const char *> name = nullptr;
+        std::atomic<std::int64_t> begin_ns = 0;
+        std::atomic<std::int64_t> duration_ns = 0;
+        std::atomic<std::uint64_t> generation = 0;
+      };
+
+      std::size_t thread_index_;
+      std::vector<Slot> slots_;
+      std::atomic<std::size_t> written_number_ = 0;
+    };
+
+    // Buffers outlive their threads, so the spans of finished worker threads can still be dumped. A finished
+    // thread hands its buffer back for the next new thread to continue, so the number of buffers is bounded by
+    // the number of threads alive at once rather than by the threads ever started, such as the short-lived
+    // threads of a caller that starts one per request.
+    struct TraceRegistry {
+      std::mutex mutex;
+      std::vector<std::unique_ptr<TraceBuffer>> buffers;
+      std::vector<TraceBuffer *> free_buffers;
+      std::atomic<bool> is_enabled = false;
+      std::atomic<std::uint64_t> generation = 0;
+      const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    };
+
+    TraceRegistry &GetRegistry() {
+      static TraceRegistry registry;
+      return registry;
+    }
+
+    // The trace event format counts time in microseconds.
+    std::string FormatMicroseconds(std::int64_t nanoseconds) {
+      auto fraction = std::to_string(nanoseconds % 1000);
+      return std::to_string(nanoseconds / 1000) + "." + std::string(3 - fraction.size(), '0') + fraction;
+    }
+
+#ifndef AUTOMATA_DISABLE_TRACING
+    class ThreadBufferLease {
+    public:
+      ThreadBufferLease() {
+        auto &registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        if (registry.free_buffers.empty()) {
+          registry.buffers.push_back(std::make_unique<TraceBuffer>(registry.buffers.size()));
+          buffer_ = registry.buffers.back().get();
+        } else {
+          buffer_ = registry.free_buffers.back();
+          registry.free_buffers.pop_back();
+        }
+      }
+
+      ~ThreadBufferLease() {
+        auto &registry = GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        registry.free_buffers.push_back(buffer_);
+      }
+
+      ThreadBufferLease(const ThreadBufferLease &) = delete;
+
+      ThreadBufferLease &operator=(const ThreadBufferLease &) = delete;
+
+      TraceBuffer &buffer() const {
+        return *buffer_;
+      }
+
+    private:
+      TraceBuffer *buffer_;
+    };
+
+    TraceBuffer &GetThreadBuffer() {
+      thread_local ThreadBufferLease lease;
+      return lease.buffer();
+    }
+#endif
+  }
+
+  void SetTracingEnabled(bool enabled) {
+    GetRegistry().is_enabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  bool IsTracingEnabled() {
+    return GetRegistry().is_enabled.load(std::memory_order_relaxed);
+  }
+
+  void WriteChromeTrace(std::ostream &os) {
+    auto &registry = GetRegistry();
+    std::lock_guard lock(registry.mutex);
+    os << "{\"traceEvents\": [";
+    bool is_first = true;
+    auto generation = registry.generation.load(std::memory_order_relaxed);
+    for (const auto &buffer: registry.buffers) {
+      buffer->ForEachEvent(generation, [&](const TraceEvent &event) {
+        os << (is_first ? "" : ",") << "\n  {\"name\": \"" << event.name << "\", \"cat\": \"automata\", "
+           << "\"ph\": \"X\", \"pid\": 0, \"tid\": " << buffer->thread_index() << ", \"ts\": "
+           << FormatMicroseconds(event.begin_ns) << ", \"dur\": " << FormatMicroseconds(event.duration_ns) << "}";
+        is_first = false;
+      });
+    }
+    os << "\n], \"displayTimeUnit\": \"ns\"}" << std::endl;
+  }
+
+  void ClearTrace() {
+    GetRegistry().generation.fetch_add(1, std::memory_order_relaxed);
+  }
+
+#ifndef AUTOMATA_DISABLE_TRACING
+  TraceSpan::TraceSpan(const char *name) : name_(IsTracingEnabled() ? name : nullptr) {
+    if (name_) {
+      begin_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  TraceSpan::~TraceSpan() {
+    if (!name_) {
+      return;
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto &registry = GetRegistry();
+    GetThreadBuffer().Add({name_, std::chrono::duration_cast<std::chrono::nanoseconds>(begin_ - registry.epoch).count(),
+                           std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin_).count()},
+                          registry.generation.load(std::memory_order_relaxed));
+  }
+#endif
+}
@@ -1,9 +1,42 @@
 #include "doctest.h"
 #include "automaton.h"
+#include "batch_matcher.h"
+#include "binary_format.h"
+#include "compiled_dfa.h"
+#include "lazy_dfa.h"
+#include "max_matching_prefix.h"
+#include "multi_pattern_matcher.h"
+#include "nfa_simulator.h"
+#include "parallel.h"
+#include "prefilter.h"
+#include "product.h"
+#include "statistics.h"
+#include "stream_matcher.h"
+#include "text_format.h"
+#include "trace.h"
+#include <atomic>
+#include <filesystem>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
 #include "regex.h"
 
 using namespace automata;
 
+DeterministicAutomaton GenerateCompleteAutomaton(std::mt19937 &generator, std::size_t state_number,
+                                                 const std::string &alphabet) {
+  std::uniform_int_distribution<std::size_t> state_distribution(0, state_number - 1);
+  DeterministicAutomaton automaton{state_number, state_distribution(generator)};
+  for (std::size_t state = 0; state < state_number; ++state) {
+    automaton.SetAccepting(state, generator() % 3 == 0);
+    for (char symbol: alphabet) {
+      automaton.AddTransition(state, state_distribution(generator), symbol);
+    }
+  }
+  return automaton;
+}
+
 TEST_SUITE("Automaton I/O") {
   TEST_CASE("Add accepting state") {
     DeterministicAutomaton automaton{3, 1, {0}};
@@ -29,6 +62,55 @@ TEST_SUITE("Automaton I/O") {
     CHECK_EQ(DeterministicAutomaton{3, 1, {0, 2}, {{1, 2, 'a'}, {1, 0, 'b'}}}, Parse<DeterministicAutomaton>(input));
   }
 
+  TEST_CASE("Bulk text parser agrees with Parse") {
+    auto check_valid = [](const std::string &input) {
+      std::istringstream deterministic_input(input);
+      CHECK_EQ(Parse<DeterministicAutomaton>(deterministic_input), ParseText<DeterministicAutomaton>(input));
+      std::istringstream nondeterministic_input(input);
+      CHECK_EQ(Parse<NondeterministicAutomaton>(nondeterministic_input), ParseText<NondeterministicAutomaton>(input));
+    };
+    check_valid("3 1\n0 2\n1 2 a\n1 0 b\n1 1 a\n\n");
+    check_valid("0 0\n\n\n");
+    check_valid("2  0\n\n0\t1  \ta\n\nignored");
+    check_valid("2\n0\n1\n0\n1 a\n\n");
+    check_valid("2 0\n1\n0 1a\n\n");
+
+    for (std::string input: {"2 0", "2 0 \n1\n\n", "2 0\r\n1\n\n", "2 0\n1\n0 1 a\r\n\n", "2 0\n1\n0 1 a\n",
+                             "2 0\n1\n0 1 a \n\n", "2 0\n1\n0 1 a", "2 0\n1\n0 1 a\n1 0 b"}) {
+      std::istringstream deterministic_input(input);
+      CHECK_THROWS_AS(Parse<DeterministicAutomaton>(deterministic_input), InvalidInputException);
+      CHECK_THROWS_AS(ParseText<DeterministicAutomaton>(input), InvalidInputException);
+      std::istringstream nondeterministic_input(input);
+      CHECK_THROWS_AS(Parse<NondeterministicAutomaton>(nondeterministic_input), InvalidInputException);
+      CHECK_THROWS_AS(ParseText<NondeterministicAutomaton>(input), InvalidInputException);
+    }
+    std::string input = "2 0\n1\n0 1 abc\n\n";
+    std::istringstream deterministic_input(input);
+    CHECK_THROWS_AS(Parse<DeterministicAutomaton>(deterministic_input), InvalidInputException);
+    CHECK_THROWS_AS(ParseText<DeterministicAutomaton>(input), InvalidInputException);
+    std::istringstream nondeterministic_input(input);
+    CHECK_EQ(Parse<NondeterministicAutomaton>(nondeterministic_input), ParseText<NondeterministicAutomaton>(input));
+  }
+
+  TEST_CASE("Bulk text parser reports where the error is") {
+    auto get_error = [](const std::string &input) {
+      try {
+        ParseText<DeterministicAutomaton>(input);
+      } catch (const InvalidInputException &e) {
+        return std::string(e.what());
+      }
+      return std::string();
+    };
+    CHECK_EQ(get_error("x 0\n"), "line 1, column 1: number of states expected, got \"x\"");
+    CHECK_EQ(get_error("2 0\n1\n0 1 a\n1 5 b\n"), "line 4, column 3: state 5 does not exist");
+    CHECK_EQ(get_error("2 0\n1\n0 1 ab\n"), "line 3, column 5: transition of a deterministic automaton must be "
+                                               "a single symbol");
+    CHECK_EQ(get_error("2 0\n1\n0 1 a b\n"), "line 3, column 6: end of line expected");
+    CHECK_EQ(get_error("2 0\n1\n0 1\n"), "line 4, column 1: transition string expected");
+    CHECK_EQ(get_error("2 0\n1\n0 1 a\n"), "line 4, column 1: source state expected");
+    CHECK_THROWS_AS(LoadText<DeterministicAutomaton>("/nonexistent/automaton.txt"), std::system_error);
+  }
+
   TEST_CASE("Print automaton") {
     DeterministicAutomaton automaton{3, 1, {0, 2}, {{1, 2, 'a'}, {1, 0, 'b'}}};
     std::ostringstream output;
@@ -50,6 +132,462 @@ TEST_SUITE("Automaton accepts string") {
   }
 }
 
+TEST_SUITE("Compiled DFA") {
+  TEST_CASE("Accepts the same strings as the automaton") {
+    DeterministicAutomaton automaton{3, 0, {0, 2}, {{0, 1, 'a'}, {1, 2, 'b'}, {2, 1, 'a'}}};
+    CompiledDfa compiled(automaton);
+    for (std::string string: {"", "a", "ab", "aba", "abab", "b", "abb", "ababx"}) {
+      CHECK_EQ(automaton.AcceptsString(string), compiled.Accepts(string));
+    }
+  }
+
+  TEST_CASE("Missing transition leads to dead state") {
+    CompiledDfa compiled(DeterministicAutomaton{2, 0, {0, 1}, {{0, 1, 'a'}}});
+    CHECK_EQ(CompiledDfa::kDeadState, compiled.Run("ab"));
+    CHECK_EQ(CompiledDfa::kDeadState, compiled.Run("abaa"));
+    CHECK_FALSE(compiled.IsAccepting(CompiledDfa::kDeadState));
+  }
+
+  TEST_CASE("Non-ASCII symbols") {
+    CompiledDfa compiled(DeterministicAutomaton{2, 0, {1}, {{0, 1, '\xff'}, {1, 1, '\x80'}}});
+    CHECK(compiled.Accepts("\xff\x80\x80"));
+    CHECK_FALSE(compiled.Accepts("\x80"));
+  }
+
+  TEST_CASE("Run continues from a given state") {
+    CompiledDfa compiled(DeterministicAutomaton{3, 0, {2}, {{0, 1, 'a'}, {1, 2, 'b'}}});
+    CHECK(compiled.IsAccepting(compiled.Run(compiled.Run("a"), "b")));
+  }
+
+  TEST_CASE("States that cannot reach an accepting state are dead") {
+    CompiledDfa compiled(DeterministicAutomaton{4, 0, {2}, {{0, 1, 'a'}, {1, 2, 'b'}, {0, 3, 'b'}, {3, 3, 'a'}}});
+    CHECK_EQ(CompiledDfa::kDeadState, compiled.Run("b"));
+    CHECK_NE(CompiledDfa::kDeadState, compiled.Run("a"));
+    CHECK_EQ(CompiledDfa::kDeadState, CompiledDfa(DeterministicAutomaton{2, 0, {}, {{0, 1, 'a'}}}).initial_state());
+  }
+
+  TEST_CASE("Interleaved kernels agree with one string at a time") {
+    auto regex = regex::Regex::Parse("(a+b)*a(a+b)(a+b)");
+    auto automaton = RegexToMCDFA(regex, {'a', 'b'});
+    CompiledDfa compiled(automaton);
+    std::mt19937 generator(19);
+    std::vector<std::string> strings(CompiledDfa::kMaxInterleavedStrings);
+    for (auto &string : strings) {
+      // Long enough to span several blocks of the AVX2 kernel; the strings die at their first c.
+      auto length = std::uniform_int_distribution<std::size_t>(0, 300)(generator);
+      for (std::size_t i = 0; i < length; ++i) {
+        string += std::uniform_int_distribution<int>(0, 150)(generator) ? 'a' + generator() % 2 : 'c';
+      }
+    }
+    std::vector<std::string_view> views(strings.begin(), strings.end());
+    for (auto count : {std::size_t{0}, std::size_t{5}, std::size_t{8}, std::size_t{37}, views.size()}) {
+      std::uint64_t expected = 0;
+      for (std::size_t i = 0; i < count; ++i) {
+        expected |= std::uint64_t{automaton.AcceptsString(strings[i])} << i;
+      }
+      CHECK_EQ(expected, compiled.AcceptsInterleaved(views.data(), count, CompiledDfa::Kernel::kScalar));
+      CHECK_EQ(expected, compiled.AcceptsInterleaved(views.data(), count, CompiledDfa::Kernel::kAvx2));
+    }
+    CompiledDfa dead(DeterministicAutomaton{1, 0, {}, {{0, 0, 'a'}}});
+    for (auto kernel : {CompiledDfa::Kernel::kScalar, CompiledDfa::Kernel::kAvx2}) {
+      CHECK_EQ(dead.AcceptsInterleaved(views.data(), views.size(), kernel), 0);
+    }
+    CHECK_THROWS_AS(compiled.AcceptsInterleaved(views.data(), views.size() + 1), InvalidInputException);
+  }
+}
+
+TEST_SUITE("Binary format") {
+  TEST_CASE("Deterministic automata survive a round trip") {
+    auto automaton = RegexToMCDFA(regex::Regex::Parse("(a+b)*abb"), {'a', 'b'});
+    auto image = MappedAutomaton::FromBuffer(ToBinary(automaton));
+    CHECK_EQ(image.kind(), BinaryAutomatonKind::kDeterministic);
+    CHECK_EQ(image.header().state_number, automaton.GetStateNumber());
+    CHECK_EQ(image.header().alphabet[0], 0);
+    CHECK_EQ(image.header().alphabet[1], (std::uint64_t{1} << ('a' - 64)) | (std::uint64_t{1} << ('b' - 64)));
+    CHECK_EQ(image.ToDeterministic(), automaton);
+
+    auto compiled = image.GetCompiledDfa();
+    CompiledDfa expected(automaton);
+    CHECK(std::ranges::equal(compiled.transitions(), expected.transitions()));
+    CHECK_EQ(compiled.initial_state(), expected.initial_state());
+    for (std::string string: {"", "abb", "babb", "abab", "c"}) {
+      CHECK_EQ(compiled.Accepts(string), automaton.AcceptsString(string));
+    }
+  }
+
+  TEST_CASE("Nondeterministic automata survive a round trip") {
+    NondeterministicAutomaton automaton{3, 1, {0, 2}, {{0, 1, "ab"}, {1, 2, ""}, {1, 0, "c"}, {2, 2, "abc"}}};
+    auto image = MappedAutomaton::FromBuffer(ToBinary(automaton));
+    CHECK_EQ(image.kind(), BinaryAutomatonKind::kNondeterministic);
+    CHECK_EQ(image.ToNondeterministic(), automaton);
+    CHECK_EQ(image.GetTargets(1).size(), 2);
+    CHECK_EQ(image.GetLabel(3), "abc");
+    CHECK_THROWS_AS(image.ToDeterministic(), BadAutomatonException);
+    CHECK_THROWS_AS(image.GetCompiledDfa(), BadAutomatonException);
+  }
+
+  TEST_CASE("Mapped files are used in place") {
+    auto automaton = RegexToMCDFA(regex::Regex::Parse("a*ba*"), {});
+    auto path = (std::filesystem::temp_directory_path() / "automata_binary_format_test.bin").string();
+    SaveBinary(automaton, path);
+    auto compiled = std::make_shared<const CompiledDfa>(MappedAutomaton::Open(path).GetCompiledDfa());
+    std::filesystem::remove(path);
+    CHECK(compiled->Accepts("aabaa"));
+    CHECK_FALSE(compiled->Accepts("abab"));
+    CHECK_THROWS_AS(MappedAutomaton::Open(path), std::system_error);
+  }
+
+  TEST_CASE("Damaged images are rejected") {
+    auto image = ToBinary(RegexToMCDFA(regex::Regex::Parse("ab*"), {}));
+    auto corrupt = [&image](std::size_t offset) {
+      auto copy = image;
+      copy[offset] ^= std::byte{1};
+      return copy;
+    };
+    CHECK_THROWS_AS(MappedAutomaton::FromBuffer(corrupt(0)), InvalidInputException);
+    CHECK_THROWS_AS(MappedAutomaton::FromBuffer(corrupt(image.size() - 1)), InvalidInputException);
+    CHECK_NOTHROW(MappedAutomaton::FromBuffer(corrupt(image.size() - 1), false));
+    CHECK_THROWS_AS(MappedAutomaton::FromBuffer({image.begin(), image.end() - 64}), InvalidInputException);
+    CHECK_THROWS_AS(MappedAutomaton::FromBuffer({}), InvalidInputException);
+  }
+}
+
+TEST_SUITE("Stream matching") {
+  TEST_CASE("Chunks give the same verdict as the whole string") {
+    auto dfa = std::make_shared<const CompiledDfa>(RegexToMCDFA(regex::Regex::Parse("(ab)*(c+1)"), {}));
+    StreamMatcher matcher(dfa);
+    CHECK(matcher.IsAccepting());
+    for (std::string chunk: {"a", "ba", "", "bab"}) {
+      CHECK(matcher.Feed(chunk));
+    }
+    CHECK(matcher.IsAccepting());
+    CHECK(matcher.Feed("c"));
+    CHECK(matcher.IsAccepting());
+    CHECK_FALSE(matcher.IsDead());
+    CHECK_EQ(matcher.GetConsumedByteNumber(), 7);
+  }
+
+  TEST_CASE("Dead state stops reading") {
+    auto dfa = std::make_shared<const CompiledDfa>(RegexToMCDFA(regex::Regex::Parse("a*b"), {'a', 'b', 'c'}));
+    StreamMatcher matcher(dfa);
+    CHECK(matcher.Feed(std::string(10000, 'a')));
+    CHECK_FALSE(matcher.Feed("c" + std::string(10000, 'a')));
+    CHECK(matcher.IsDead());
+    CHECK_FALSE(matcher.IsAccepting());
+    CHECK_LT(matcher.GetConsumedByteNumber(), 20000);
+    CHECK_FALSE(matcher.Feed("b"));
+
+    matcher.Reset();
+    CHECK_FALSE(matcher.IsDead());
+    CHECK(matcher.Feed("aab"));
+    CHECK(matcher.IsAccepting());
+    CHECK_FALSE(matcher.Feed("b"));
+  }
+}
+
+TEST_SUITE("Multi-pattern matching") {
+  TEST_CASE("Every matching pattern is reported") {
+    std::vector<regex::Regex> patterns;
+    for (std::string expression: {"(a+b)*", "a*", "(a+b)*b", "ab", "1", "0", "c(a+b)*"}) {
+      patterns.push_back(regex::Regex::Parse(expression));
+    }
+    MultiPatternMatcher matcher(patterns);
+    CHECK_EQ(matcher.GetPatternNumber(), 7);
+    CHECK_EQ(matcher.Match(""), std::vector<std::size_t>{0, 1, 4});
+    CHECK_EQ(matcher.Match("aa"), std::vector<std::size_t>{0, 1});
+    CHECK_EQ(matcher.Match("ab"), std::vector<std::size_t>{0, 2, 3});
+    CHECK_EQ(matcher.Match("bab"), std::vector<std::size_t>{0, 2});
+    CHECK_EQ(matcher.Match("cab"), std::vector<std::size_t>{6});
+    CHECK(matcher.Match("abc").empty());
+  }
+
+  TEST_CASE("Agrees with separate automata") {
+    std::vector<std::string> expressions{"(a+b)*a(a+b)", "(ab+b)*", "a(a+b)*b", "(aa+b)*a", "b*ab*"};
+    std::vector<regex::Regex> patterns;
+    std::vector<DeterministicAutomaton> automata;
+    for (const auto &expression: expressions) {
+      patterns.push_back(regex::Regex::Parse(expression));
+      automata.push_back(RegexToMCDFA(patterns.back(), {'a', 'b'}));
+    }
+    MultiPatternMatcher matcher(patterns, 2);
+    std::mt19937 generator(41);
+    for (std::size_t i = 0; i < 500; ++i) {
+      std::string string(generator() % 8, 'a');
+      for (auto &symbol: string) {
+        symbol = "ab"[generator() % 2];
+      }
+      std::vector<std::size_t> expected;
+      for (std::size_t pattern = 0; pattern < automata.size(); ++pattern) {
+        if (automata[pattern].AcceptsString(string)) {
+          expected.push_back(pattern);
+        }
+      }
+      CHECK_EQ(matcher.Match(string), expected);
+    }
+  }
+
+  TEST_CASE("Minimization keeps patterns apart") {
+    DeterministicAutomaton automaton{3, 0, {1, 2}, {{0, 1, 'a'}, {0, 2, 'b'}, {1, 1, 'a'}, {1, 1, 'b'},
+                                                    {2, 2, 'a'}, {2, 2, 'b'}}};
+    CHECK_EQ(automaton.Minimize().GetStateNumber(), 2);
+    std::vector<std::size_t> labels{0, 1, 2};
+    CHECK_EQ(automaton.MinimizeLabeled(labels), automaton);
+    CHECK_EQ(labels, std::vector<std::size_t>{0, 1, 2});
+    labels = {5, 7, 7};
+    CHECK_EQ(automaton.MinimizeLabeled(labels).GetStateNumber(), 2);
+    CHECK_EQ(labels, std::vector<std::size_t>{5, 7});
+  }
+}
+
+TEST_SUITE("Batch matching") {
+  TEST_CASE("Agrees with single matches") {
+    auto dfa = std::make_shared<const CompiledDfa>(RegexToMCDFA(regex::Regex::Parse("(a+b)*ab(a+b)*"), {}));
+    std::mt19937 generator(37);
+    std::vector<std::string> strings(10000);
+    for (auto &string: strings) {
+      string.resize(generator() % 10);
+      for (auto &symbol: string) {
+        symbol = "abc"[generator() % 3];
+      }
+    }
+    std::vector<std::string_view> views(strings.begin(), strings.end());
+    std::string blob;
+    std::vector<std::size_t> offsets{0};
+    for (const auto &string: strings) {
+      blob += string;
+      offsets.push_back(blob.size());
+    }
+
+    BatchMatcher single_threaded(dfa, 1);
+    BatchMatcher multi_threaded(dfa, 4);
+    auto result = single_threaded.Match(views);
+    CHECK_EQ(result.size(), strings.size());
+    std::size_t accepted_number = 0;
+    for (std::size_t i = 0; i < strings.size(); ++i) {
+      CHECK_EQ(result[i], dfa->Accepts(strings[i]));
+      accepted_number += result[i];
+    }
+    CHECK_EQ(result.GetAcceptedNumber(), accepted_number);
+    CHECK(multi_threaded.Match(views).words() == result.words());
+    CHECK(multi_threaded.Match(blob, offsets).words() == result.words());
+
+    auto statistics = multi_threaded.GetStatistics();
+    CHECK_EQ(statistics.batch_number, 2);
+    CHECK_EQ(statistics.string_number, 2 * strings.size());
+    CHECK_EQ(statistics.byte_number, 2 * blob.size());
+  }
+
+  TEST_CASE("Empty batch") {
+    BatchMatcher matcher(std::make_shared<const CompiledDfa>(DeterministicAutomaton{1, 0, {0}, {}}));
+    CHECK_EQ(matcher.Match(std::vector<std::string_view>{}).size(), 0);
+    CHECK_THROWS_AS(matcher.Match("ab", std::vector<std::size_t>{0, 3}), InvalidInputException);
+  }
+
+  TEST_CASE("Offsets out of order") {
+    BatchMatcher matcher(std::make_shared<const CompiledDfa>(DeterministicAutomaton{1, 0, {0}, {}}), 4);
+    std::string blob(10, 'a');
+    CHECK_THROWS_AS(matcher.Match(blob, std::vector<std::size_t>{0, 20, 10}), InvalidInputException);
+    CHECK_THROWS_AS(matcher.Match(blob, std::vector<std::size_t>{0, 5, 3}), InvalidInputException);
+    CHECK_EQ(matcher.Match(blob, std::vector<std::size_t>{0, 3, 3, 10}).size(), 3);
+  }
+}
+
+TEST_SUITE("Literal prefilter") {
+  std::vector<std::string> RequiredLiterals(const std::string &expression) {
+    return GetRequiredLiterals(regex::Regex::Parse(expression));
+  }
+
+  TEST_CASE("Required literals") {
+    CHECK_EQ(RequiredLiterals("(a+b)*abba(a+b)*"), (std::vector<std::string>{"abba"}));
+    CHECK_EQ(RequiredLiterals("(a+b)*(ab+ba)c(a+b)*"), (std::vector<std::string>{"abc", "bac"}));
+    CHECK_EQ(RequiredLiterals("a*bc*+a*cb*"), (std::vector<std::string>{"b", "c"}));
+    CHECK_EQ(RequiredLiterals("(ab)*"), (std::vector<std::string>{""}));
+    CHECK_EQ(RequiredLiterals("a*+b"), (std::vector<std::string>{""}));
+    CHECK_EQ(RequiredLiterals("a0"), (std::vector<std::string>{}));
+  }
+
+  TEST_CASE("Prefilter never rejects a match") {
+    std::mt19937 generator(20);
+    for (const auto &expression: {"(a+b+c)*abc(a+b+c)*", "a*(bc+cb)a*(ab+1)", "(a+b)*(aa+bb)c*", "(abc)*", "c0+a"}) {
+      auto regex = regex::Regex::Parse(expression);
+      auto automaton = RegexToMCDFA(regex, {'a', 'b', 'c'});
+      LiteralPrefilter prefilter(regex);
+      for (std::size_t i = 0; i < 2000; ++i) {
+        std::string string(generator() % 12, 'a');
+        for (auto &symbol: string) {
+          symbol = "abc"[generator() % 3];
+        }
+        if (automaton.AcceptsString(string)) {
+          CHECK(prefilter.MayMatch(string));
+        }
+      }
+    }
+  }
+
+  TEST_CASE("Batch results do not change") {
+    auto regex = regex::Regex::Parse("(a+b+c)*cab(a+b+c)*");
+    auto dfa = std::make_shared<const CompiledDfa>(RegexToMCDFA(regex, {}));
+    std::mt19937 generator(21);
+    std::vector<std::string> strings(5000);
+    for (auto &string: strings) {
+      string.resize(generator() % 20);
+      for (auto &symbol: string) {
+        symbol = "abc"[generator() % 3];
+      }
+    }
+    std::vector<std::string_view> views(strings.begin(), strings.end());
+    BatchMatcher matcher(dfa, 2);
+    BatchMatcher prefiltered_matcher(dfa, LiteralPrefilter(regex), 2);
+    auto result = prefiltered_matcher.Match(views);
+    CHECK(result.words() == matcher.Match(views).words());
+    auto statistics = prefiltered_matcher.GetStatistics();
+    CHECK_GT(statistics.prefiltered_number, 0);
+    CHECK_EQ(statistics.prefiltered_number + result.GetAcceptedNumber() <= strings.size(), true);
+    CHECK_EQ(matcher.GetStatistics().prefiltered_number, 0);
+  }
+}
+
+TEST_SUITE("Lazy DFA") {
+  NondeterministicAutomaton NthSymbolFromEndIsA(std::size_t n) {
+    std::string expression = "(a+b)*a";
+    for (std::size_t i = 0; i < n; ++i) {
+      expression += "(a+b)";
+    }
+    auto automaton = NondeterministicAutomaton::FromRegex(regex::Regex::Parse(expression)).RemoveEmptyTransitions();
+    automaton.SplitTransitions();
+    return automaton;
+  }
+
+  std::vector<std::string> GenerateStrings(std::mt19937 &generator, std::size_t count, std::size_t max_length) {
+    std::vector<std::string> strings;
+    for (std::size_t i = 0; i < count; ++i) {
+      std::string string(generator() % (max_length + 1), 'a');
+      for (auto &symbol: string) {
+        symbol = "abc"[generator() % 3];
+      }
+      strings.push_back(std::move(string));
+    }
+    return strings;
+  }
+
+  TEST_CASE("Agrees with determinized automaton") {
+    auto automaton = NthSymbolFromEndIsA(4);
+    auto deterministic = automaton.Determinize();
+    LazyDfa lazy(automaton);
+    std::mt19937 generator(3);
+    for (const auto &string: GenerateStrings(generator, 300, 12)) {
+      CHECK_EQ(deterministic.AcceptsString(string), lazy.AcceptsString(string));
+    }
+    CHECK(lazy.GetCachedStateNumber() <= deterministic.GetStateNumber() + 1);
+  }
+
+  TEST_CASE("Cache is flushed when memory limit is reached") {
+    auto automaton = NthSymbolFromEndIsA(6);
+    auto deterministic = automaton.Determinize();
+    LazyDfa lazy(automaton, 1);
+    std::mt19937 generator(5);
+    for (const auto &string: GenerateStrings(generator, 100, 20)) {
+      CHECK_EQ(deterministic.AcceptsString(string), lazy.AcceptsString(string));
+    }
+    CHECK(lazy.GetCacheFlushNumber() > 0);
+  }
+
+  TEST_CASE("Shared between threads") {
+    auto automaton = NthSymbolFromEndIsA(5);
+    auto deterministic = automaton.Determinize();
+    LazyDfa lazy(automaton, 16 << 10);
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> mismatches = 0;
+    for (unsigned seed = 0; seed < 4; ++seed) {
+      threads.emplace_back([&, seed]() {
+        std::mt19937 generator(seed);
+        for (const auto &string: GenerateStrings(generator, 200, 16)) {
+          if (deterministic.AcceptsString(string) != lazy.AcceptsString(string)) {
+            ++mismatches;
+          }
+        }
+      });
+    }
+    for (auto &thread: threads) {
+      thread.join();
+    }
+    CHECK_EQ(0, mismatches.load());
+  }
+
+  TEST_CASE("Transitions must be single-letter") {
+    CHECK_THROWS_AS(LazyDfa(NondeterministicAutomaton{2, 0, {1}, {{0, 1, "ab"}}}), BadAutomatonException);
+  }
+}
+
+TEST_SUITE("NFA simulation") {
+  TEST_CASE("Empty and long transitions") {
+    NondeterministicAutomaton automaton{4, 0, {3}, {{0, 1, ""}, {1, 2, "ab"}, {2, 1, ""}, {2, 3, "c"}}};
+    CHECK(automaton.AcceptsString("abc"));
+    CHECK(automaton.AcceptsString("ababc"));
+    CHECK_FALSE(automaton.AcceptsString("c"));
+    CHECK_FALSE(automaton.AcceptsString("abca"));
+  }
+
+  TEST_CASE("Changes are seen by AcceptsString") {
+    NondeterministicAutomaton automaton{2, 0, {1}, {{0, 1, "a"}}};
+    CHECK(automaton.AcceptsString("a"));
+    CHECK_FALSE(automaton.AcceptsString("ab"));
+    auto copy = automaton;
+    automaton.AddTransition(1, 1, "b");
+    CHECK(automaton.AcceptsString("ab"));
+    CHECK_FALSE(copy.AcceptsString("ab"));
+    automaton.SetAccepting(0);
+    CHECK(automaton.AcceptsString(""));
+    automaton.SetInitialState(1);
+    CHECK_FALSE(automaton.AcceptsString("a"));
+    copy = automaton;
+    CHECK(copy.AcceptsString("bb"));
+    automaton.AddTransition(automaton.AddState(), 0, "c");
+    automaton.SetInitialState(2);
+    CHECK(automaton.AcceptsString("c"));
+    CHECK(copy.AcceptsString(""));
+    CHECK_FALSE(copy.AcceptsString("c"));
+  }
+
+  TEST_CASE("Agrees with determinized automaton") {
+    std::mt19937 generator(11);
+    for (std::string expression: {"(a+b)*a(a+b)(a+b)", "(ab+c)*(1+a)", "0", "1", "(a*b*c)*aab", "a(b+1)(c+0)*"}) {
+      auto automaton = NondeterministicAutomaton::FromRegex(regex::Regex::Parse(expression));
+      auto deterministic = automaton.Determinize();
+      NfaSimulator simulator(automaton);
+      CHECK(simulator.IsBitParallel());
+      for (std::size_t i = 0; i < 200; ++i) {
+        std::string string(generator() % 8, 'a');
+        for (auto &symbol: string) {
+          symbol = "abc"[generator() % 3];
+        }
+        CHECK_EQ(deterministic.AcceptsString(string), simulator.AcceptsString(string));
+      }
+    }
+  }
+
+  TEST_CASE("Large automata") {
+    auto check_nth_symbol_from_end = [](const NfaSimulator &simulator, std::size_t n) {
+      std::string string(n + 1, 'b');
+      CHECK_FALSE(simulator.AcceptsString(string));
+      string[0] = 'a';
+      CHECK(simulator.AcceptsString(string));
+      CHECK(simulator.AcceptsString("b" + string));
+      CHECK_FALSE(simulator.AcceptsString(string + "b"));
+    };
+    std::string expression = "(a+b)*a";
+    for (std::size_t n = 1; n <= 700; ++n) {
+      expression += "(a+b)";
+      // Beyond 4096 states, the successors are kept as lists rather than masks.
+      if (n == 40 || n == 70 || n == 700) {
+        NfaSimulator simulator(NondeterministicAutomaton::FromRegex(regex::Regex::Parse(expression)));
+        CHECK_EQ(n == 40, simulator.IsBitParallel());
+        check_nth_symbol_from_end(simulator, n);
+      }
+    }
+  }
+}
+
 TEST_SUITE("Split transitions") {
   TEST_CASE("Short transitions") {
     CHECK_EQ(
@@ -67,11 +605,60 @@ TEST_SUITE("Split transitions") {
   }
 }
 
-TEST_CASE("Remove empty transitions") {
-  CHECK_EQ(
-      NondeterministicAutomaton{5, 0, {1}, {{1, 0, ""}, {2, 1, ""}, {3, 2, ""}, {1, 4, "ab"}}}.RemoveEmptyTransitions(),
-      NondeterministicAutomaton{5, 0, {1, 2, 3}, {{1, 4, "ab"}, {2, 4, "ab"}, {3, 4, "ab"}}}
-  );
+TEST_SUITE("Remove empty transitions") {
+  TEST_CASE("Chain") {
+    CHECK_EQ(
+        NondeterministicAutomaton{5, 0, {1}, {{1, 0, ""}, {2, 1, ""}, {3, 2, ""}, {1, 4, "ab"}}}.RemoveEmptyTransitions(),
+        NondeterministicAutomaton{5, 0, {1, 2, 3}, {{1, 4, "ab"}, {2, 4, "ab"}, {3, 4, "ab"}}}
+    );
+  }
+
+  TEST_CASE("Cycles") {
+    NondeterministicAutomaton automaton{5, 0, {4}, {{0, 1, ""}, {1, 2, ""}, {2, 0, ""}, {2, 3, "a"}, {3, 4, ""},
+                                                    {4, 3, ""}, {4, 0, "b"}, {1, 1, "c"}}};
+    CHECK_EQ(automaton.RemoveEmptyTransitions(),
+             NondeterministicAutomaton{5, 0, {3, 4}, {{0, 3, "a"}, {0, 1, "c"}, {1, 3, "a"}, {1, 1, "c"},
+                                                      {2, 3, "a"}, {2, 1, "c"}, {3, 0, "b"}, {4, 0, "b"}}});
+  }
+
+  TEST_CASE("Random automata") {
+    std::mt19937 generator(31);
+    for (std::size_t i = 0; i < 50; ++i) {
+      std::size_t state_number = 1 + generator() % 30;
+      NondeterministicAutomaton automaton{state_number, 0};
+      for (std::size_t transition = 0; transition < 2 * state_number; ++transition) {
+        automaton.AddTransition(generator() % state_number, generator() % state_number,
+                                generator() % 2 ? "" : std::string(1, "ab"[generator() % 2]));
+      }
+      for (std::size_t state = 0; state < state_number; ++state) {
+        automaton.SetAccepting(state, generator() % 5 == 0);
+      }
+      // Closures by a separate search from every state.
+      NondeterministicAutomaton expected{state_number, 0};
+      for (std::size_t from_state = 0; from_state < state_number; ++from_state) {
+        std::vector<bool> visited(state_number);
+        std::vector<std::size_t> to_process{from_state};
+        visited[from_state] = true;
+        while (!to_process.empty()) {
+          auto state = to_process.back();
+          to_process.pop_back();
+          if (automaton.IsAccepting(state)) {
+            expected.SetAccepting(from_state);
+          }
+          for (const auto &transition: automaton.GetTransitions(state)) {
+            if (!transition.symbol.empty()) {
+              expected.AddTransition(from_state, transition.to_state, transition.symbol);
+            } else if (!visited[transition.to_state]) {
+              visited[transition.to_state] = true;
+              to_process.push_back(transition.to_state);
+            }
+          }
+        }
+        expected.RemoveDuplicateTransitions(from_state);
+      }
+      CHECK_EQ(automaton.RemoveEmptyTransitions(), expected);
+    }
+  }
 }
 
 TEST_SUITE("Determinize") {
@@ -103,6 +690,41 @@ TEST_SUITE("Determinize") {
         DeterministicAutomaton{4, 0, {1, 2}, {{0, 2, 'a'}, {0, 1, 'b'}, {1, 3, 'b'}, {2, 2, 'b'}, {3, 1, 'b'}}}
     );
   }
+
+  TEST_CASE("Subsets of more than 64 states") {
+    std::string expression = "(a+b)*a";
+    for (std::size_t i = 0; i < 10; ++i) {
+      expression += "(a+b)";
+    }
+    auto automaton = NondeterministicAutomaton::FromRegex(regex::Regex::Parse(expression)).RemoveEmptyTransitions();
+    automaton.SplitTransitions();
+    CHECK_GT(automaton.GetStateNumber(), 64);
+    auto determinized = automaton.DeterminizeSingleLetterTransitions();
+    CHECK_EQ(determinized.GetStateNumber(), 2049);
+    CHECK(determinized.AcceptsString("ba" + std::string(10, 'b')));
+    CHECK_FALSE(determinized.AcceptsString("ab" + std::string(10, 'b')));
+  }
+
+  TEST_CASE("Parallel determinization") {
+    std::mt19937 generator(29);
+    for (std::string expression: {"(a+b)*a(a+b)(a+b)(a+b)(a+b)(a+b)(a+b)(a+b)(a+b)", "(ab+c)*(1+a)", "0", "1",
+                                  "(a*b*c)*aab(a+b+c)*(bb+c)"}) {
+      auto automaton = NondeterministicAutomaton::FromRegex(regex::Regex::Parse(expression));
+      auto determinized = automaton.Determinize();
+      CHECK_EQ(determinized, automaton.Determinize(2));
+      CHECK_EQ(determinized, automaton.Determinize(8));
+    }
+    for (std::size_t i = 0; i < 20; ++i) {
+      NondeterministicAutomaton automaton{14, 0};
+      for (std::size_t state = 0; state < 14; ++state) {
+        automaton.SetAccepting(state, generator() % 4 == 0);
+        for (std::size_t transition = 0; transition < 4; ++transition) {
+          automaton.AddTransition(state, generator() % 14, std::string(1, "abc"[generator() % 3]));
+        }
+      }
+      CHECK_EQ(automaton.DeterminizeSingleLetterTransitions(), automaton.DeterminizeSingleLetterTransitions(4));
+    }
+  }
 }
 
 TEST_CASE("Make complete") {
@@ -148,11 +770,10 @@ TEST_SUITE("Build regular expression by automaton") {
   }
 
   TEST_CASE("Long regex") {
-    CHECK_EQ(
-        NondeterministicAutomaton{4, 1, {2}, {{1, 0, "a"}, {0, 3, "a"}, {0, 2, "b"}, {3, 2, "a"}, {3, 1, "b"},
-                                              {2, 1, "a"}}}.ToRegex().ToString(),
-        "(aab)*(ab+aaa)(a(aab)*(ab+aaa))*"
-    );
+    NondeterministicAutomaton automaton{4, 1, {2}, {{1, 0, "a"}, {0, 3, "a"}, {0, 2, "b"}, {3, 2, "a"}, {3, 1, "b"},
+                                                    {2, 1, "a"}}};
+    CHECK_EQ(automaton.ToRegex().ToString(), "(aab)*a(b+aa)(a(aab)*a(b+aa))*");
+    CHECK_EQ(automaton.ToRegex(false).ToString(), "(aab)*(ab+aaa)(a(aab)*(ab+aaa))*");
   }
 
   TEST_CASE("Empty transition") {
@@ -194,6 +815,259 @@ TEST_SUITE("Minimization") {
   }
 }
 
+TEST_SUITE("Minimization algorithms agree") {
+  TEST_CASE("Random complete automata") {
+    std::mt19937 generator(17);
+    for (std::size_t state_number = 1; state_number <= 40; ++state_number) {
+      auto automaton = GenerateCompleteAutomaton(generator, state_number, state_number % 2 ? "ab" : "abc");
+      CHECK_EQ(automaton.Minimize(MinimizationAlgorithm::kMoore), automaton.Minimize(MinimizationAlgorithm::kHopcroft));
+    }
+  }
+
+  TEST_CASE("Parallel Moore") {
+    std::mt19937 generator(19);
+    for (std::size_t state_number: {1, 100, 10000}) {
+      // Every state gets a copy, so that the minimal automaton is smaller than the original one.
+      auto original = GenerateCompleteAutomaton(generator, state_number, "ab");
+      DeterministicAutomaton automaton{2 * state_number, original.initial_state()};
+      for (std::size_t state = 0; state < 2 * state_number; ++state) {
+        automaton.SetAccepting(state, original.IsAccepting(state % state_number));
+        for (char symbol: {'a', 'b'}) {
+          auto to_state = *original.GetNextState(state % state_number, symbol) + generator() % 2 * state_number;
+          automaton.AddTransition(state, to_state, symbol);
+        }
+      }
+      auto minimized = automaton.Minimize(MinimizationAlgorithm::kHopcroft);
+      CHECK_EQ(minimized, automaton.Minimize(MinimizationAlgorithm::kMoore, 4));
+      CHECK_EQ(minimized, automaton.Minimize(MinimizationAlgorithm::kMoore, 3));
+    }
+  }
+
+  TEST_CASE("Incomplete automaton") {
+    DeterministicAutomaton automaton{2, 0, {1}, {{0, 1, 'a'}, {0, 0, 'b'}, {1, 1, 'a'}, {1, 0, 'c'}}};
+    CHECK_THROWS_AS(automaton.Minimize(MinimizationAlgorithm::kHopcroft), BadAutomatonException);
+    CHECK_THROWS_AS(DeterministicAutomaton({2, 0, {1}, {{0, 1, 'a'}}}).Minimize(), BadAutomatonException);
+  }
+
+  TEST_CASE("Hopcroft's algorithm takes no threads") {
+    DeterministicAutomaton automaton{1, 0, {0}, {{0, 0, 'a'}}};
+    CHECK_THROWS_AS(automaton.Minimize(MinimizationAlgorithm::kHopcroft, 2), std::invalid_argument);
+  }
+}
+
+TEST_SUITE("Parallel for") {
+  TEST_CASE("Chunks cover the range in order") {
+    std::vector<std::size_t> chunk_begins(4);
+    std::vector<int> visit_numbers(1000);
+    ParallelFor(visit_numbers.size(), chunk_begins.size(), [&](std::size_t begin, std::size_t end,
+                                                               std::size_t chunk) {
+      chunk_begins[chunk] = begin;
+      for (auto i = begin; i < end; ++i) {
+        ++visit_numbers[i];
+      }
+    });
+    CHECK_EQ(chunk_begins, std::vector<std::size_t>{0, 250, 500, 750});
+    CHECK_EQ(visit_numbers, std::vector<int>(1000, 1));
+  }
+
+  TEST_CASE("Threads are reused") {
+    auto run = [] {
+      ParallelFor(4, 4, [](std::size_t, std::size_t, std::size_t) {});
+    };
+    run();
+    auto thread_number = ThreadPool::Get().GetThreadNumber();
+    for (int i = 0; i < 100; ++i) {
+      run();
+    }
+    CHECK_EQ(ThreadPool::Get().GetThreadNumber(), thread_number);
+  }
+
+  TEST_CASE("Chunks may wait for each other") {
+    // Every chunk of the outer call waits for all the others, and runs a call of its own meanwhile.
+    std::atomic<std::size_t> started_number = 0;
+    std::atomic<std::size_t> sum = 0;
+    ParallelFor(4, 4, [&](std::size_t, std::size_t, std::size_t) {
+      started_number.fetch_add(1);
+      ParallelFor(3, 3, [&sum](std::size_t begin, std::size_t, std::size_t) {
+        sum.fetch_add(begin);
+      });
+      while (started_number.load() < 4) {
+        std::this_thread::yield();
+      }
+    });
+    CHECK_EQ(sum.load(), 4 * 3);
+  }
+}
+
+#ifndef AUTOMATA_DISABLE_STATISTICS
+TEST_SUITE("Statistics") {
+  TEST_CASE("Counters follow the algorithms") {
+    ResetStatistics();
+    auto automaton = NondeterministicAutomaton::FromRegex(regex::Regex::Parse("(a+b)*a(a+b)"));
+    std::size_t empty_transition_number = 0;
+    automaton.ForEachTransition([&empty_transition_number](auto, auto, const auto &symbol) {
+      empty_transition_number += symbol.empty();
+    });
+    auto determinized = automaton.Determinize();
+    auto statistics = GetStatistics();
+    CHECK_EQ(statistics[Counter::kEmptyTransitionsRemoved], empty_transition_number);
+    CHECK_EQ(statistics[Counter::kSubsetsCreated], determinized.GetStateNumber());
+    std::size_t transition_number = 0;
+    determinized.ForEachTransition([&transition_number](auto, auto, auto) {
+      ++transition_number;
+    });
+    CHECK_EQ(statistics[Counter::kSubsetHashHits], transition_number + 1 - determinized.GetStateNumber());
+    ResetStatistics();
+    automaton.Determinize(4);
+    CHECK_EQ(GetStatistics()[Counter::kSubsetsCreated], determinized.GetStateNumber());
+    CHECK_EQ(GetStatistics()[Counter::kSubsetHashHits], transition_number + 1 - determinized.GetStateNumber());
+
+    determinized.MakeComplete({'a', 'b'});
+    for (auto algorithm: {MinimizationAlgorithm::kMoore, MinimizationAlgorithm::kHopcroft}) {
+      ResetStatistics();
+      auto minimized = determinized.Minimize(algorithm);
+      CHECK_EQ(GetStatistics()[Counter::kMinimizationBlocks], minimized.GetStateNumber());
+      CHECK_GT(GetStatistics()[Counter::kMinimizationRounds], 0);
+    }
+
+    ResetStatistics();
+    CHECK_EQ(GetStatistics()[Counter::kMinimizationRounds], 0);
+    auto product = determinized.Intersection(determinized);
+    CHECK_EQ(GetStatistics()[Counter::kProductTuples], product.GetStateNumber());
+    CHECK_EQ(2, MaxMatchingPrefixFinder::GetMaxMatchingPrefix(regex::Regex::Parse("ab*"), "abc"));
+    CHECK_EQ(GetStatistics()[Counter::kPrefixQueuePushes], 3);
+  }
+}
+#endif
+
+#ifndef AUTOMATA_DISABLE_TRACING
+TEST_SUITE("Trace") {
+  TEST_CASE("Spans are recorded only while tracing is enabled") {
+    ClearTrace();
+    RegexComplement(regex::Regex::Parse("(a+b)*a"), {'a', 'b'});
+    std::ostringstream empty_trace;
+    WriteChromeTrace(empty_trace);
+    CHECK_EQ(empty_trace.str().find("\"ph\""), std::string::npos);
+
+    SetTracingEnabled(true);
+    RegexComplement(regex::Regex::Parse("(a+b)*a"), {'a', 'b'});
+    SetTracingEnabled(false);
+    std::ostringstream trace;
+    WriteChromeTrace(trace);
+    for (const auto *name: {"Parse", "RegexComplement", "RegexToMCDFA", "FromRegex", "Determinize",
+                            "RemoveEmptyTransitions", "SubsetConstruction", "MakeComplete", "Minimize",
+                            "ToRegex"}) {
+      CHECK_NE(trace.str().find("\"name\": \"" + std::string(name) + "\""), std::string::npos);
+    }
+    CHECK_NE(trace.str().find("\"ph\": \"X\""), std::string::npos);
+
+    ClearTrace();
+    std::ostringstream cleared_trace;
+    WriteChromeTrace(cleared_trace);
+    CHECK_EQ(cleared_trace.str().find("\"ph\""), std::string::npos);
+  }
+
+  TEST_CASE("Finished threads hand their buffers over") {
+    ClearTrace();
+    SetTracingEnabled(true);
+    for (int i = 0; i < 10; ++i) {
+      std::jthread([] {
+        TraceSpan span("Worker");
+      }).join();
+    }
+    SetTracingEnabled(false);
+    std::ostringstream trace;
+    WriteChromeTrace(trace);
+    std::set<std::string> thread_ids;
+    std::size_t span_number = 0;
+    for (auto position = trace.str().find("\"tid\": "); position != std::string::npos;
+         position = trace.str().find("\"tid\": ", position + 1)) {
+      thread_ids.insert(trace.str().substr(position, trace.str().find(',', position) - position));
+      ++span_number;
+    }
+    CHECK_EQ(span_number, 10);
+    CHECK_EQ(thread_ids.size(), 1);
+    ClearTrace();
+  }
+
+  TEST_CASE("Dumping and clearing while other threads record") {
+    SetTracingEnabled(true);
+    std::atomic<bool> is_done = false;
+    std::jthread worker([&is_done] {
+      while (!is_done.load()) {
+        TraceSpan span("Busy");
+      }
+    });
+    for (int i = 0; i < 100; ++i) {
+      std::ostringstream trace;
+      WriteChromeTrace(trace);
+      CHECK_EQ(trace.str().find("\"name\": \"Busy\""), trace.str().find("\"name\": \""));
+      ClearTrace();
+    }
+    is_done = true;
+    worker.join();
+    SetTracingEnabled(false);
+    ClearTrace();
+  }
+}
+#endif
+
+TEST_SUITE("Product construction") {
+  DeterministicAutomaton GetLengthModuloAutomaton(std::size_t modulo) {
+    DeterministicAutomaton automaton{modulo, 0, {0}};
+    for (std::size_t state = 0; state < modulo; ++state) {
+      automaton.AddTransition(state, (state + 1) % modulo, 'a');
+    }
+    return automaton;
+  }
+
+  TEST_CASE("Several automata") {
+    auto first = GetLengthModuloAutomaton(2);
+    auto second = GetLengthModuloAutomaton(3);
+    auto third = GetLengthModuloAutomaton(5);
+    auto product = ProductBuilder({&first, &second, &third}).Build();
+    CHECK_EQ(product.GetStateNumber(), 30);
+    CHECK(product.AcceptsString(std::string(60, 'a')));
+    CHECK_FALSE(product.AcceptsString(std::string(10, 'a')));
+    CHECK_FALSE(ProductBuilder({&first, &second, &third}).IsEmpty());
+  }
+
+  TEST_CASE("Only reachable states") {
+    DeterministicAutomaton first{100, 0, {1}, {{0, 1, 'a'}}};
+    DeterministicAutomaton second{100, 0, {1}, {{0, 1, 'a'}, {0, 2, 'b'}}};
+    CHECK_EQ(first.Intersection(second), DeterministicAutomaton{2, 0, {1}, {{0, 1, 'a'}}});
+  }
+
+  TEST_CASE("Empty intersection") {
+    auto even = GetLengthModuloAutomaton(2);
+    DeterministicAutomaton odd{2, 0, {1}, {{0, 1, 'a'}, {1, 0, 'a'}}};
+    CHECK(ProductBuilder({&even, &odd}).IsEmpty());
+    CHECK(ProductBuilder({&odd, &even, &odd}, 4).IsEmpty());
+    CHECK_FALSE(ProductBuilder({&odd}).IsEmpty());
+  }
+
+  TEST_CASE("Independent of thread number") {
+    std::mt19937 generator(23);
+    std::vector<DeterministicAutomaton> automata;
+    for (std::size_t i = 0; i < 3; ++i) {
+      automata.push_back(GenerateCompleteAutomaton(generator, 40, "abc"));
+    }
+    std::vector<const DeterministicAutomaton *> pointers{&automata[0], &automata[1], &automata[2]};
+    auto product = ProductBuilder(pointers, 1).Build();
+    CHECK_GT(product.GetStateNumber(), 20000);
+    CHECK_EQ(product, ProductBuilder(pointers, 8).Build());
+    for (std::size_t i = 0; i < 200; ++i) {
+      std::string string(generator() % 12, 'a');
+      for (auto &symbol: string) {
+        symbol = "abc"[generator() % 3];
+      }
+      CHECK_EQ(product.AcceptsString(string), std::ranges::all_of(automata, [&string](const auto &automaton) {
+        return automaton.AcceptsString(string);
+      }));
+    }
+  }
+}
+
 TEST_SUITE("Automaton isomorphism check") {
   TEST_CASE("Different state count") {
     CHECK_FALSE(DeterministicAutomaton{1, 0, {0}, {}}.IsIsomorphic(DeterministicAutomaton{2, 0, {}, {}}));
@@ -229,3 +1103,102 @@ TEST_SUITE("Automaton isomorphism check") {
     CHECK_FALSE(second.IsIsomorphic(first));
   }
 }
+
+TEST_SUITE("DFA equivalence") {
+  TEST_CASE("Missing transitions go to a sink") {
+    DeterministicAutomaton first{2, 0, {1}, {{0, 1, 'a'}}};
+    DeterministicAutomaton second{3, 0, {1}, {{0, 1, 'a'}, {0, 2, 'b'}, {1, 2, 'a'}, {2, 2, 'a'}}};
+    CHECK(first.IsEquivalent(second));
+    CHECK_FALSE(first.FindDistinguishingWord(second));
+  }
+
+  TEST_CASE("Shortest distinguishing word") {
+    DeterministicAutomaton first{3, 0, {1}, {{0, 1, 'a'}, {1, 0, 'a'}}};
+    DeterministicAutomaton second{3, 0, {1}, {{0, 1, 'a'}, {1, 2, 'a'}}};
+    CHECK_EQ(first.FindDistinguishingWord(second), std::optional<std::string>("aaa"));
+    CHECK_EQ(DeterministicAutomaton{1, 0, {0}, {}}.FindDistinguishingWord(DeterministicAutomaton{1, 0, {}, {}}),
+             std::optional<std::string>(""));
+  }
+
+  TEST_CASE("Large products") {
+    // Too many pairs of states for a bitmap of visited pairs.
+    std::size_t length = 12000;
+    DeterministicAutomaton first{length + 1, 0, {length}};
+    DeterministicAutomaton second{length + 1, 0, {length - 1}};
+    for (std::size_t state = 0; state < length; ++state) {
+      first.AddTransition(state, state + 1, 'a');
+      second.AddTransition(state, state + 1, 'a');
+    }
+    CHECK_EQ(first.FindDistinguishingWord(second), std::optional<std::string>(std::string(length - 1, 'a')));
+    CHECK(first.IsEquivalent(first));
+  }
+
+  TEST_CASE("Agrees with minimized automata") {
+    std::vector<std::string> expressions{"(a+b)*a(a+b)", "(a+b)*(aa+ab)", "(ab+b)*", "(b*ab)*b*", "a*", "(aa)*a"};
+    for (const auto &first: expressions) {
+      for (const auto &second: expressions) {
+        auto first_automaton = NondeterministicAutomaton::FromRegex(regex::Regex::Parse(first)).Determinize();
+        auto second_automaton = NondeterministicAutomaton::FromRegex(regex::Regex::Parse(second)).Determinize();
+        auto word = first_automaton.FindDistinguishingWord(second_automaton);
+        CHECK_EQ(!word, first_automaton.ToComplete({}).Minimize().IsIsomorphic(
+            second_automaton.ToComplete({}).Minimize()));
+        if (word) {
+          CHECK_NE(first_automaton.AcceptsString(*word), second_automaton.AcceptsString(*word));
+          NondeterministicAutomaton first_nfa(first_automaton), second_nfa(second_automaton);
+          auto first_word = first_nfa.FindInclusionCounterexample(second_nfa);
+          auto second_word = second_nfa.FindInclusionCounterexample(first_nfa);
+          CHECK_EQ(word->size(), std::min(first_word.value_or(second_word.value_or("")).size(),
+                                          second_word.value_or(first_word.value_or("")).size()));
+        }
+      }
+    }
+  }
+}
+
+TEST_SUITE("Language inclusion") {
+  TEST_CASE("Shortest counterexample") {
+    auto first = NondeterministicAutomaton::FromRegex(regex::Regex::Parse("(a+b)*"));
+    auto second = NondeterministicAutomaton::FromRegex(regex::Regex::Parse("(a+bb)*"));
+    CHECK(second.IsSubsetOf(first));
+    CHECK_EQ(first.FindInclusionCounterexample(second), std::optional<std::string>("b"));
+    CHECK_EQ(first.FindDistinguishingWord(second), std::optional<std::string>("b"));
+    CHECK_EQ(second.FindDistinguishingWord(first), std::optional<std::string>("b"));
+  }
+
+  TEST_CASE("Empty word") {
+    auto first = NondeterministicAutomaton::FromRegex(regex::Regex::Parse("a*"));
+    auto second = NondeterministicAutomaton::FromRegex(regex::Regex::Parse("aa*"));
+    CHECK_EQ(first.FindInclusionCounterexample(second), std::optional<std::string>(""));
+    CHECK_FALSE(second.FindInclusionCounterexample(first));
+  }
+
+  TEST_CASE("Empty and long transitions") {
+    NondeterministicAutomaton first{4, 0, {3}, {{0, 1, ""}, {1, 2, "ab"}, {2, 1, ""}, {2, 3, "c"}}};
+    auto second = NondeterministicAutomaton::FromRegex(regex::Regex::Parse("ab(ab)*c"), RegexConstruction::kGlushkov);
+    CHECK(first.IsEquivalent(second));
+    CHECK_EQ(first.FindDistinguishingWord(NondeterministicAutomaton::FromRegex(regex::Regex::Parse("(ab)*c"))),
+             std::optional<std::string>("c"));
+  }
+
+  TEST_CASE("Agrees with minimized automata") {
+    std::vector<std::string> expressions{"(a+b)*a(a+b)", "(a+b)*(aa+ab)", "a(a+b)*+b(a+b)*", "(a+b)(a+b)*",
+                                         "(ab+b)*", "(b*ab)*b*", "0", "1"};
+    for (const auto &first: expressions) {
+      for (const auto &second: expressions) {
+        auto first_regex = regex::Regex::Parse(first);
+        auto second_regex = regex::Regex::Parse(second);
+        auto first_automaton = NondeterministicAutomaton::FromRegex(first_regex);
+        auto second_automaton = NondeterministicAutomaton::FromRegex(second_regex);
+        CHECK_EQ(first_automaton.IsEquivalent(second_automaton),
+                 RegexToMCDFA(first_regex, {'a', 'b'}).IsEquivalent(RegexToMCDFA(second_regex, {'a', 'b'})));
+        if (auto word = first_automaton.FindInclusionCounterexample(second_automaton)) {
+          CHECK(first_automaton.AcceptsString(*word));
+          CHECK_FALSE(second_automaton.AcceptsString(*word));
+        } else {
+          auto union_regex = regex::Regex::Parse("(" + first + ")+(" + second + ")");
+          CHECK(RegexToMCDFA(union_regex, {'a', 'b'}).IsEquivalent(RegexToMCDFA(second_regex, {'a', 'b'})));
+        }
+      }
+    }
+  }
+}
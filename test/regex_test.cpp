@@ -74,6 +74,70 @@ TEST_SUITE("Parse reverse Polish notation") {
   }
 }
 
+TEST_SUITE("Regex node store") {
+  TEST_CASE("Equal subexpressions are the same node") {
+    auto first = Regex::Parse("(a+b)*c(a+b)");
+    auto second = Create<Literal>('a') + Create<Literal>('b');
+    CHECK(first.IsIdentical((second.Iterate() * Create<Literal>('c')) * second));
+    CHECK_EQ(first.root().children()[1], first.root().children()[0]->children()[0]->children()[0]);
+    CHECK_FALSE(first.IsIdentical(Regex::Parse("(a+b)*c(b+a)")));
+  }
+
+  TEST_CASE("Parsing an existing regex creates no nodes") {
+    auto store = std::make_shared<NodeStore>();
+    Regex::Parse("(ab+c)*a", store);
+    auto node_number = store->GetNodeNumber();
+    Regex::Parse("(ab+c)*a", store);
+    CHECK_EQ(node_number, store->GetNodeNumber());
+    CHECK_EQ(7, node_number);
+  }
+
+  TEST_CASE("Regexes from different stores") {
+    auto store = std::make_shared<NodeStore>();
+    auto local = Regex::Parse("ab", store);
+    auto combined = local * Regex::Parse("c*");
+    CHECK_EQ(store.get(), &combined.store());
+    CHECK_EQ("abc*", combined.ToString());
+    auto node_number = store->GetNodeNumber();
+    CHECK(combined.IsIdentical(Regex::Parse("abc*")));
+    CHECK(Regex::Parse("abc*").IsIdentical(combined));
+    CHECK_FALSE(combined.IsIdentical(Regex::Parse("abc")));
+    CHECK_EQ(node_number, store->GetNodeNumber());
+  }
+
+  TEST_CASE("The smaller operand is imported") {
+    auto large = Regex::Parse("(ab+ba)*(a+bb)");
+    auto node_number = large.store().GetNodeNumber();
+    auto prefixed = Create<Literal>('c') * large;
+    CHECK_EQ(&large.store(), &prefixed.store());
+    CHECK_EQ(node_number + 2, large.store().GetNodeNumber());
+    auto alternative = Create<Empty>() + prefixed;
+    CHECK_EQ(&large.store(), &alternative.store());
+    CHECK_EQ("1+c(ab+ba)*(a+bb)", alternative.ToString());
+  }
+
+  TEST_CASE("A store lives as long as its regexes") {
+    std::weak_ptr<NodeStore> store;
+    Regex iterated;
+    {
+      auto regex = Regex::Parse("a+b");
+      store = regex.shared_store();
+      iterated = regex.Iterate();
+    }
+    CHECK_FALSE(store.expired());
+    CHECK_EQ("(a+b)*", iterated.ToString());
+    iterated = Regex::Parse("c");
+    CHECK(store.expired());
+  }
+
+  TEST_CASE("State elimination keeps only the result") {
+    auto automaton = NondeterministicAutomaton::FromRegex(Regex::Parse("(ab+ba)*(a+bb)(ab)*"));
+    auto regex = automaton.MakeSingleAcceptingState().ToRegex();
+    CHECK(regex == Regex::Parse("(ab+ba)*(a+bb)(ab)*"));
+    CHECK_EQ(regex.store().GetNodeNumber(), regex.ImportTo(std::make_shared<NodeStore>()).store().GetNodeNumber());
+  }
+}
+
 TEST_CASE("Input operator for regex") {
   std::istringstream is("c+a*b");
   Regex regex;
@@ -127,9 +191,140 @@ TEST_SUITE("Create automaton by regex") {
   }
 }
 
+TEST_SUITE("Create position automaton by regex") {
+  NondeterministicAutomaton FromRegexGlushkov(const std::string &expression) {
+    return NondeterministicAutomaton::FromRegex(regex::Regex::Parse(expression), RegexConstruction::kGlushkov);
+  }
+
+  TEST_CASE("Empty set") {
+    CHECK_EQ(FromRegexGlushkov("0"), NondeterministicAutomaton{1, 0, {}, {}});
+  }
+
+  TEST_CASE("Empty string") {
+    CHECK_EQ(FromRegexGlushkov("1"), NondeterministicAutomaton{1, 0, {0}, {}});
+  }
+
+  TEST_CASE("Concatenation") {
+    CHECK_EQ(FromRegexGlushkov("ab"), NondeterministicAutomaton{3, 0, {2}, {{0, 1, "a"}, {1, 2, "b"}}});
+  }
+
+  TEST_CASE("Alteration") {
+    CHECK_EQ(FromRegexGlushkov("a+b"), NondeterministicAutomaton{3, 0, {1, 2}, {{0, 1, "a"}, {0, 2, "b"}}});
+  }
+
+  TEST_CASE("Compound regex") {
+    CHECK_EQ(
+        FromRegexGlushkov("(a*+b)c*"),
+        NondeterministicAutomaton{4, 0, {0, 1, 2, 3},
+                                  {{0, 1, "a"}, {0, 2, "b"}, {0, 3, "c"}, {1, 1, "a"}, {1, 3, "c"}, {2, 3, "c"},
+                                   {3, 3, "c"}}}
+    );
+  }
+
+  TEST_CASE("Same minimal automaton as Thompson construction") {
+    for (std::string expression: {"0", "1", "(a+b)*a(a+b)(a+b)", "(ab+c)*(1+a)", "(a*b*c)*aab", "a(b+1)(c+0)*"}) {
+      auto regex = regex::Regex::Parse(expression);
+      CHECK(RegexToMCDFA(regex, {'a', 'b'}, RegexConstruction::kGlushkov).IsEquivalent(
+          RegexToMCDFA(regex, {'a', 'b'}, RegexConstruction::kThompson)));
+    }
+  }
+}
+
+TEST_SUITE("Regex derivatives") {
+  TEST_CASE("Derivative by a symbol") {
+    DerivativeBuilder builder;
+    auto regex = Regex::Parse("(ab+b)*a");
+    CHECK(builder.GetDerivative(regex, 'a') == Regex::Parse("1+b(ab+b)*a"));
+    CHECK(builder.GetDerivative(regex, 'b').IsIdentical(Regex::Parse("(ab+b)*a")));
+    CHECK(builder.GetDerivative(regex, 'c').IsIdentical(Create<None>()));
+    CHECK_FALSE(builder.IsNullable(regex));
+    CHECK(builder.IsNullable(builder.GetDerivative(regex, 'a')));
+  }
+
+  TEST_CASE("Derivative automaton") {
+    CHECK_EQ(
+        DeterministicAutomaton::FromRegexDerivatives(Regex::Parse("a*b"), {}),
+        DeterministicAutomaton{3, 0, {1}, {{0, 0, 'a'}, {0, 1, 'b'}, {1, 2, 'a'}, {1, 2, 'b'}, {2, 2, 'a'},
+                                           {2, 2, 'b'}}}
+    );
+  }
+
+  TEST_CASE("Same language as Thompson construction") {
+    for (std::string expression: {"0", "1", "(a+b)*a(a+b)(a+b)", "(ab+c)*(1+a)", "(a*b*c)*aab", "a(b+1)(c+0)*",
+                                  "((a+b)*+c)*(a+ab+abb)"}) {
+      auto regex = Regex::Parse(expression);
+      auto derivative_automaton = RegexToMCDFA(regex, {'a', 'b'}, RegexConstruction::kDerivatives);
+      CHECK(derivative_automaton.IsEquivalent(RegexToMCDFA(regex, {'a', 'b'})));
+      CHECK(derivative_automaton.IsComplete());
+      CHECK(NondeterministicAutomaton::FromRegex(regex, RegexConstruction::kDerivatives).Determinize().IsEquivalent(
+          RegexToMCDFA(regex, {}, RegexConstruction::kDerivatives)));
+    }
+  }
+
+  TEST_CASE("Every construction gives the same MCDFA") {
+    for (std::string expression: {"0", "1", "a", "(a+b)*a(a+b)(a+b)", "(ab+c)*(1+a)", "(a*b*c)*aab", "a(b+1)(c+0)*",
+                                  "((a+b)*+c)*(a+ab+abb)", "(a+b)*"}) {
+      auto regex = Regex::Parse(expression);
+      for (const auto &alphabet: {std::vector<char>{}, std::vector<char>{'a', 'b'}, std::vector<char>{'d'}}) {
+        auto thompson_automaton = RegexToMCDFA(regex, alphabet, RegexConstruction::kThompson);
+        CHECK_EQ(thompson_automaton, RegexToMCDFA(regex, alphabet, RegexConstruction::kGlushkov));
+        CHECK_EQ(thompson_automaton, RegexToMCDFA(regex, alphabet, RegexConstruction::kDerivatives));
+      }
+    }
+  }
+}
+
 TEST_CASE("Regex complement") {
   auto expression = regex::Regex::Parse("aa");
-  CHECK_EQ(automata::RegexComplement(expression, {'a', 'b'}).ToString(), "1+a+(b+ab+aa(a+b))(a+b)*");
+  CHECK_EQ(automata::RegexComplement(expression, {'a', 'b'}).ToString(), "1+a+(b+a(b+a(a+b)))(a+b)*");
+  CHECK_EQ(automata::RegexComplement(expression, {'a', 'b'}, false).ToString(), "1+a+(b+ab+aa(a+b))(a+b)*");
+}
+
+TEST_SUITE("Simplify regex") {
+  void CheckSimplified(const std::string &expression, const std::string &simplified) {
+    auto regex = regex::Regex::Parse(expression);
+    CHECK_EQ(regex.Simplify().ToString(), simplified);
+    CHECK(regex.Simplify() == regex);
+  }
+
+  TEST_CASE("Idempotent and sorted alternatives") {
+    CheckSimplified("b+a+b+0", "a+b");
+    CheckSimplified("(c+a)+(b+a)", "a+b+c");
+  }
+
+  TEST_CASE("Star absorbs contained terms") {
+    CheckSimplified("a+a*", "a*");
+    CheckSimplified("1+a*b", "1+a*b");
+    CheckSimplified("1+aa*", "a*");
+    CheckSimplified("a+b+(a+b)*", "(a+b)*");
+  }
+
+  TEST_CASE("Nested stars") {
+    CheckSimplified("(a*)*", "a*");
+    CheckSimplified("(1+a)*", "a*");
+    CheckSimplified("(a*b*)*", "(a+b)*");
+    CheckSimplified("(a*+b)*", "(a+b)*");
+  }
+
+  TEST_CASE("Adjacent stars") {
+    CheckSimplified("a*a*", "a*");
+    CheckSimplified("a*(a+b)*", "(a+b)*");
+    CheckSimplified("(a+b)*b*c", "(a+b)*c");
+  }
+
+  TEST_CASE("Common prefixes and suffixes") {
+    CheckSimplified("abc+abd", "ab(c+d)");
+    CheckSimplified("ca+ba", "(b+c)a");
+    CheckSimplified("ab+ac+d", "d+a(b+c)");
+  }
+
+  TEST_CASE("Simplified regexes are equivalent") {
+    for (std::string expression: {"(a+1)(a+1)(1+a)", "(ab+ac)*(a+a*)", "((a+b)*+c)*(a+ab+abb)", "0*+1a+(0+1)*"}) {
+      auto regex = regex::Regex::Parse(expression);
+      CHECK(regex.Simplify() == regex);
+      CHECK(regex.Simplify().IsIdentical(regex.Simplify().Simplify()));
+    }
+  }
 }
 
 TEST_SUITE("Regex equivalence") {
@@ -165,8 +360,8 @@ TEST_SUITE("Regex equivalence") {
 TEST_CASE("Automaton intersection") {
   DeterministicAutomaton first{2, 0, {1}, {{0, 1, 'a'}, {1, 0, 'a'}, {0, 0, 'b'}, {1, 1, 'b'}}};
   DeterministicAutomaton second{2, 1, {0}, {{0, 1, 'b'}, {1, 0, 'b'}, {0, 0, 'a'}, {1, 1, 'a'}}};
-  CHECK_EQ(first.Intersection(second), DeterministicAutomaton{4, 1, {2},
-                                                              {{0, 2, 'a'}, {0, 1, 'b'}, {1, 3, 'a'}, {1, 0, 'b'},
-                                                               {2, 0, 'a'}, {2, 3, 'b'}, {3, 1, 'a'}, {3, 2, 'b'}}});
+  CHECK_EQ(first.Intersection(second), DeterministicAutomaton{4, 0, {3},
+                                                              {{0, 1, 'a'}, {0, 2, 'b'}, {1, 0, 'a'}, {1, 3, 'b'},
+                                                               {2, 3, 'a'}, {2, 0, 'b'}, {3, 2, 'a'}, {3, 1, 'b'}}});
 }
 